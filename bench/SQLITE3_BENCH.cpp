@@ -0,0 +1,237 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+// Benchmarks of the wrapper hot paths against raw sqlite3_step loops
+//
+// usage: SQLitePlus_BENCH [repetitions]
+// every case is run repetitions times (default 3) and the median is reported
+
+#include "SQLITE3.hpp"
+#include "SQLITE3_QUERY.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+// count every heap allocation made by the process
+static std::atomic<uint64_t> allocation_count(0);
+
+void *operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = std::malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+/**
+ * Measurement of a benchmark case
+ */
+struct SAMPLE {
+    double seconds;
+    uint64_t allocations;
+};
+
+/**
+ * Run op iterations times, repeat repetitions times and print the median
+ * @param name name of case
+ * @param rows rows touched by one op
+ * @param cols columns of each row
+ * @param iterations ops per repetition
+ * @param repetitions number of repetitions
+ * @param op operation to measure
+ */
+static void run_case(const std::string &name, size_t rows, size_t cols, size_t iterations, size_t repetitions,
+                     const std::function<void()> &op) {
+    op(); // warm up caches and the statement cache
+
+    std::vector<SAMPLE> samples;
+    for (size_t r = 0; r < repetitions; ++r) {
+        uint64_t allocations = allocation_count.load();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            op();
+        }
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back({std::chrono::duration<double>(end - start).count(),
+                           allocation_count.load() - allocations});
+    }
+    std::sort(samples.begin(), samples.end(), [](const SAMPLE &a, const SAMPLE &b) {
+        return a.seconds < b.seconds;
+    });
+    const SAMPLE &median = samples[samples.size() / 2];
+
+    double ns_per_op = median.seconds * 1e9 / (double) iterations;
+    double rows_per_second = (double) (rows * iterations) / median.seconds;
+    double allocations_per_op = (double) median.allocations / (double) iterations;
+    printf("%-34s %9zu %5zu %14.1f %14.0f %12.1f\n", name.c_str(), rows, cols, ns_per_op, rows_per_second,
+           allocations_per_op);
+}
+
+/**
+ * Create table bench_<cols> holding rows rows of cols integer and text columns
+ */
+static void fill_table(SQLITE3 &db, size_t rows, size_t cols) {
+    std::string table = "bench_" + std::to_string(cols);
+    std::string sql = "DROP TABLE IF EXISTS " + table + "; CREATE TABLE " + table + " (id INTEGER PRIMARY KEY";
+    std::vector<std::string> columns = {"id"};
+    for (size_t c = 1; c < cols; ++c) {
+        std::string column = "c" + std::to_string(c);
+        sql += ", " + column + (c % 2 ? " INTEGER" : " TEXT");
+        columns.push_back(column);
+    }
+    sql += ");";
+    db.execute(sql);
+
+    size_t row = 0;
+    db.bulk_insert(table, columns, [&row, rows, cols](SQLITE3_QUERY &q) {
+        if (row == rows) {
+            return false;
+        }
+        q.add_binding(row);
+        for (size_t c = 1; c < cols; ++c) {
+            if (c % 2) {
+                q.add_binding(row * c);
+            } else {
+                q.add_binding("text value " + std::to_string(row));
+            }
+        }
+        row += 1;
+        return true;
+    });
+    db.commit();
+}
+
+int main(int argc, char *argv[]) {
+    size_t repetitions = argc > 1 ? (size_t) std::max(1, atoi(argv[1])) : 3;
+
+    SQLITE3 db(":memory:");
+    sqlite3 *raw = const_cast<sqlite3 *>(db.get_db());
+
+    printf("%-34s %9s %5s %14s %14s %12s\n", "case", "rows", "cols", "ns/op", "rows/s", "allocs/op");
+
+    const size_t row_counts[] = {1, 1000, 100000};
+    const size_t col_counts[] = {1, 4, 16};
+    for (size_t cols : col_counts) {
+        fill_table(db, row_counts[2], cols);
+        std::string table = "bench_" + std::to_string(cols);
+
+        for (size_t rows : row_counts) {
+            size_t iterations = std::max<size_t>(1, 50000 / rows);
+            std::string select = "SELECT * FROM " + table + " WHERE id < " + std::to_string(rows) + ";";
+
+            // baseline, step through the rows and touch every column
+            sqlite3_stmt *stmt = nullptr;
+            sqlite3_prepare_v2(raw, select.c_str(), -1, &stmt, nullptr);
+            run_case("raw sqlite3_step", rows, cols, iterations, repetitions, [stmt, cols] {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    for (size_t c = 0; c < cols; ++c) {
+                        sqlite3_column_text(stmt, (int) c);
+                    }
+                }
+                sqlite3_reset(stmt);
+            });
+            sqlite3_finalize(stmt);
+
+            // sqlite3_exec and exec_callback materialization
+            run_case("execute(std::string &)", rows, cols, iterations, repetitions, [&db, &select] {
+                db.execute(select);
+            });
+
+            // prepared statement cache and native binding
+            SQLITE3_QUERY query("SELECT * FROM " + table + " WHERE id < ?;");
+            query.add_binding(rows);
+            run_case("execute(SQLITE3_QUERY &)", rows, cols, iterations, repetitions, [&db, &query] {
+                db.execute(query);
+            });
+
+            // cursor, nothing materialized
+            run_case("query(SQLITE3_QUERY &) cursor", rows, cols, iterations, repetitions, [&db, &query, cols] {
+                auto cursor = db.query(query);
+                while (cursor.next()) {
+                    for (size_t c = 0; c < cols; ++c) {
+                        sqlite3_column_text(cursor.get_stmt(), (int) c);
+                    }
+                }
+            });
+
+            // columnar result
+            db.set_result_mode(COLUMNAR_RESULT);
+            run_case("execute(SQLITE3_QUERY &) columnar", rows, cols, iterations, repetitions, [&db, &query] {
+                db.execute(query);
+            });
+            db.set_result_mode(ROW_RESULT);
+
+            // copy of the row result, the first call after a query builds the rows
+            run_case("execute + copy_result() cold", rows, cols, iterations, repetitions, [&db, &query] {
+                db.execute(query);
+                db.copy_result();
+            });
+            run_case("copy_result() warm", rows, cols, iterations, repetitions, [&db] {
+                db.copy_result();
+            });
+        }
+    }
+
+    // bind() builds the SQL text of a query
+    SQLITE3_QUERY insert("INSERT INTO bench_4 VALUES (?, ?, ?, ?);");
+    insert.add_binding(1, 2, "three", 4);
+    run_case("SQLITE3_QUERY::bind()", 1, 4, 200000, repetitions, [&insert] {
+        insert.bind();
+    });
+
+    // single row inserts
+    db.execute("CREATE TABLE bench_insert (id INTEGER, a INTEGER, b TEXT, c INTEGER);");
+    int64_t id = 0;
+    run_case("execute(SQLITE3_QUERY &) insert", 1, 4, 100000, repetitions, [&db, &insert, &id] {
+        insert.set_query_template("INSERT INTO bench_insert VALUES (?, ?, ?, ?);").reset_binding();
+        insert.add_binding(id++, 2, "three", 4);
+        db.execute(insert);
+    });
+    sqlite3_stmt *raw_insert = nullptr;
+    sqlite3_prepare_v2(raw, "INSERT INTO bench_insert VALUES (?, ?, ?, ?);", -1, &raw_insert, nullptr);
+    run_case("raw sqlite3_step insert", 1, 4, 100000, repetitions, [raw_insert, &id] {
+        sqlite3_bind_int64(raw_insert, 1, id++);
+        sqlite3_bind_int64(raw_insert, 2, 2);
+        sqlite3_bind_text(raw_insert, 3, "three", 5, SQLITE_STATIC);
+        sqlite3_bind_int64(raw_insert, 4, 4);
+        sqlite3_step(raw_insert);
+        sqlite3_reset(raw_insert);
+    });
+    sqlite3_finalize(raw_insert);
+    db.commit();
+
+    return 0;
+}
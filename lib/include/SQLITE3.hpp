@@ -23,36 +23,38 @@
 #define SQLITEPLUS_SQLITE3_HPP
 
 #include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <functional>
 #include <mutex>
+#include <thread>
 #include <utility>
 
+#include "SQLITE3_BLOB.hpp"
+#include "SQLITE3_BUSY_HANDLER.hpp"
+#include "SQLITE3_COLUMNAR_RESULT.hpp"
+#include "SQLITE3_CURSOR.hpp"
+#include "SQLITE3_ERROR.hpp"
+#include "SQLITE3_FUNCTION.hpp"
+#include "SQLITE3_OPTIONS.hpp"
+#include "SQLITE3_PROFILER.hpp"
 #include "SQLITE3_QUERY.hpp"
+#include "SQLITE3_RANGE_TABLE.hpp"
+#include "SQLITE3_RESULT.hpp"
+#include "SQLITE3_RESULT_CACHE.hpp"
+#include "SQLITE3_ROW_MAPPING.hpp"
+#include "SQLITE3_STMT_CACHE.hpp"
 
 /**
- * \private
+ * How SQLITE3 stores the result of a query
  */
-enum {NO_ERROR, OPEN_ERROR, OVERRIDE_ERROR, QUERY_BINDING_ERROR, UNINITIALIZED_ERROR, EXECUTION_ERROR};
-
-/**
- * \private
- */
-typedef std::vector<std::string> SQLITE_ROW_VECTOR;
-
-/**
- * \private
- */
-struct Callback_Data {
-    Callback_Data(std::shared_ptr<SQLITE_ROW_VECTOR> col, std::shared_ptr<std::vector<SQLITE_ROW_VECTOR>> rows) {
-        this->col = std::move(col);
-        this->rows = std::move(rows);
-    }
-
-    std::shared_ptr<SQLITE_ROW_VECTOR> col;
-    std::shared_ptr<std::vector<SQLITE_ROW_VECTOR>> rows;
-};
+enum SQLITE3_RESULT_MODE {ROW_RESULT, COLUMNAR_RESULT};
 
 /**
  * Wrapper Library for sqlite3
@@ -62,30 +64,48 @@ public:
     /**
      * Constructor
      * @param db_name name of database to open
+     * @param options settings applied to the connection, e.g. SQLITE3_OPTIONS::read_mostly()
+     * @throw std::runtime_error if the database cannot be opened or the options cannot be applied
      */
-    explicit SQLITE3(const std::string &db_name = "") {
-        // initialize db pointer
-        db = std::make_shared<sqlite3 *>();
+    explicit SQLITE3(const std::string &db_name = "", const SQLITE3_OPTIONS &options = SQLITE3_OPTIONS()) {
+        // initialize results
+        result = std::make_shared<std::shared_ptr<const SQLITE3_RESULT>>(std::make_shared<const SQLITE3_RESULT>());
+        columnar_result = std::make_shared<std::shared_ptr<const SQLITE3_COLUMNAR_RESULT>>(
+                std::make_shared<const SQLITE3_COLUMNAR_RESULT>());
+        // initialize prepared statement cache
+        stmt_cache = std::make_shared<SQLITE3_STMT_CACHE>();
+
+        // initialize profiler, attached by enable_profiling
+        profiler = std::make_shared<SQLITE3_PROFILER>();
+
+        // initialize timeout and cancellation counters
+        interrupts = std::make_shared<INTERRUPT_COUNTERS>();
+
+        // initialize result cache, enabled by set_result_cache_budget
+        result_cache = std::make_shared<SQLITE3_RESULT_CACHE>();
+
+        // initialize storage reused by the next row result
+        result_arena = std::make_shared<RESULT_ARENA>();
+
+        // initialize busy handler, installed by set_busy_backoff
+        busy_handler = std::make_shared<SQLITE3_BUSY_HANDLER>();
+
+        // initialize db pointer, the connection is closed once the last copy, cursor or blob is gone
+        CONNECTION_CLOSER closer;
+        closer.stmt_cache = stmt_cache;
+        closer.profiler = profiler;
+        closer.result_cache = result_cache;
+        closer.busy_handler = busy_handler;
+        db = std::shared_ptr<sqlite3 *>(new sqlite3 *(), closer);
+
         // open database if name is provided
         if (!db_name.empty()) {
-            int rc = sqlite3_open(db_name.c_str(), db.get());
-            if (rc != SQLITE_OK) { // check for error
+            if (open_connection(db_name, options)) { // check for error
                 error_no = OPEN_ERROR; // set error code
-
-                sqlite3_close(*db);
                 throw std::runtime_error("Unable to open database");
             }
             start_transaction();
         }
-
-        // initialize result and column vector
-        column_name = std::make_shared<SQLITE_ROW_VECTOR>();
-        result = std::make_shared<std::vector<SQLITE_ROW_VECTOR>>();
-        // initialize err_msg
-        err_msg = std::make_shared<char *>();
-
-        // initialize mutex
-        exec_lock = std::make_shared<std::mutex>();
     }
 
     /**
@@ -94,11 +114,18 @@ public:
     SQLITE3(const SQLITE3 &rhs) {
         // copy shared_pointers
         this->db = rhs.db;
-        this->err_msg = rhs.err_msg;
         this->err_msg_str = rhs.err_msg_str;
         this->result = rhs.result;
-        this->column_name = rhs.column_name;
-        this->exec_lock = rhs.exec_lock;
+        this->columnar_result = rhs.columnar_result;
+        this->result_mode = rhs.result_mode;
+        this->stmt_cache = rhs.stmt_cache;
+        this->profiler = rhs.profiler;
+        this->interrupts = rhs.interrupts;
+        this->result_cache = rhs.result_cache;
+        this->result_arena = rhs.result_arena;
+        this->busy_handler = rhs.busy_handler;
+        this->query_timeout = rhs.query_timeout;
+        this->commit_retries = rhs.commit_retries;
         this->error_no = rhs.error_no;
     }
 
@@ -110,238 +137,524 @@ public:
             return *this;
         }
 
-        // close previous database if connection exist
-        if (*db) {
-            sqlite3_close(*db);
-        }
-        if (*err_msg) {
-            sqlite3_free(*err_msg);
-        }
-
-        // copy shared_pointers
+        // copy shared_pointers, the previous connection is closed if this was its last copy
         this->db = rhs.db;
-        this->err_msg = rhs.err_msg;
         this->err_msg_str = rhs.err_msg_str;
         this->result = rhs.result;
-        this->column_name = rhs.column_name;
-        this->exec_lock = rhs.exec_lock;
+        this->columnar_result = rhs.columnar_result;
+        this->result_mode = rhs.result_mode;
+        this->stmt_cache = rhs.stmt_cache;
+        this->profiler = rhs.profiler;
+        this->interrupts = rhs.interrupts;
+        this->result_cache = rhs.result_cache;
+        this->result_arena = rhs.result_arena;
+        this->busy_handler = rhs.busy_handler;
+        this->query_timeout = rhs.query_timeout;
+        this->commit_retries = rhs.commit_retries;
         this->error_no = rhs.error_no;
 
         return *this;
     }
 
     /**
-     * Destructor
+     * Destructor, the connection is closed once its last copy, cursor or blob is gone
      */
-    ~SQLITE3() {
-        if (*db) {
-            sqlite3_close(*db);
-        }
-        if (*err_msg) {
-            sqlite3_free(*err_msg);
-        }
-    }
+    ~SQLITE3() = default;
 
     /**
      * Connect to db named db_name
      * @param db_name name of the database to open
+     * @param options settings applied to the connection, e.g. SQLITE3_OPTIONS::read_mostly()
      * @return 0 upon success, 1 upon failure
      */
-    int open(std::string &db_name) {
-        // close previous connection if needed
+    int open(std::string &db_name, const SQLITE3_OPTIONS &options = SQLITE3_OPTIONS()) {
+        // close previous connection if needed, copies of this object open the new one as well
         if (*db) {
-            sqlite3_close(*db);
-        }
-        if (*err_msg) {
-            sqlite3_free(*err_msg);
+            close_connection(*db, *stmt_cache);
+            *db = nullptr;
         }
 
         // open connection
-        int rc = sqlite3_open(db_name.c_str(), db.get());
-
-        if (rc != SQLITE_OK) { // check for error
+        if (open_connection(db_name, options)) { // check for error
             error_no = OPEN_ERROR; // set error code
-
-            sqlite3_close(*db);
             return 1;
         }
 
+        // keep profiling the new connection
+        if (profiler->is_enabled()) {
+            profiler->attach(*db, true);
+        }
+
+        // keep backing off on the new connection
+        if (busy_handler->is_enabled()) {
+            busy_handler->attach(*db, true);
+        }
+
+        // cached results belong to the previous connection
+        result_cache->clear();
+        if (result_cache->is_enabled()) {
+            result_cache->attach(*db);
+        }
+
         start_transaction();
         return 0; // all good
     }
 
     /**
      * Commit all change to database, then start a new transaction
+     *
+     * A COMMIT failing with SQLITE_BUSY leaves the transaction open, call rollback() to discard it
      * @return 0 upon success, 1 upon failure
      */
     int commit() {
-        int rc = sqlite3_exec(*db, "COMMIT;", nullptr, nullptr, err_msg.get());
-        if (rc != SQLITE_OK) { // check for error
-            // copy error message and free memory
-            err_msg_str = std::string(*err_msg);
-            sqlite3_free(*err_msg);
-            error_no = EXECUTION_ERROR;
+        // a COMMIT failing with SQLITE_BUSY leaves the transaction open, it can simply run again
+        // until the busy timeout is used up, including the time the busy handler waited within COMMIT
+        auto deadline = std::chrono::steady_clock::now() + busy_handler->get_timeout();
+        for (int attempt = 0;; ++attempt) {
+            std::chrono::microseconds remaining;
+            {
+                // statements of other threads do not run between COMMIT and BEGIN
+                DB_LOCK lock(*db);
+
+                char *err_msg = nullptr;
+                int rc = sqlite3_exec(*db, "COMMIT;", nullptr, nullptr, &err_msg);
+                if (rc == SQLITE_OK) {
+                    start_transaction();
+                    return 0;
+                }
+
+                remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+                        deadline - std::chrono::steady_clock::now());
+                if ((rc & 0xff) != SQLITE_BUSY || attempt >= commit_retries || remaining.count() <= 0) {
+                    // copy error message and free memory
+                    err_msg_str = std::string(err_msg ? err_msg : sqlite3_errmsg(*db));
+                    sqlite3_free(err_msg);
+                    error_no = EXECUTION_ERROR;
+
+                    // later statements must not run in autocommit when SQLite rolled back by itself
+                    if (sqlite3_get_autocommit(*db)) {
+                        start_transaction();
+                    }
+                    return 1;
+                }
+                sqlite3_free(err_msg);
+            }
 
-            return 1;
+            // other threads may use the connection while this one sleeps
+            busy_handler->wait_for_commit(attempt, remaining);
         }
-        start_transaction();
-        return 0;
+    }
+
+    /**
+     * Discard all change since the last commit, then start a new transaction
+     * @return 0 upon success, 1 upon failure
+     */
+    int rollback() {
+        DB_LOCK lock(*db);
+
+        // SQLite may have rolled back already
+        if (!sqlite3_get_autocommit(*db)) {
+            char *err_msg = nullptr;
+            if (sqlite3_exec(*db, "ROLLBACK;", nullptr, nullptr, &err_msg) != SQLITE_OK) { // check for error
+                // copy error message and free memory
+                err_msg_str = std::string(err_msg ? err_msg : sqlite3_errmsg(*db));
+                sqlite3_free(err_msg);
+                error_no = EXECUTION_ERROR;
+
+                return 1;
+            }
+        }
+        return start_transaction();
     }
 
     /**
      * Execute query
+     *
+     * The query template is prepared once and kept in the statement cache, bindings are bound
+     * to the cached statement with their own type. Templates that cannot be prepared on their own
+     * (e.g. ? used as a table name, or several statements) fall back to SQLITE3_QUERY::bind().
+     * Bindings fill anonymous ? parameters by position, a template with :name, @name, $name or ?NNN
+     * parameters fails with QUERY_BINDING_ERROR
      * @param query
      * @return 0 upon success, 1 upon failure
      */
     int execute(SQLITE3_QUERY &query) {
-        exec_lock->lock(); // lock exec
+        EXECUTION execution(result_mode, true);
+        int rc = execute_query(query, execution);
+        publish(execution);
+        return rc;
+    }
 
-        // check if database connection is open
-        if (!*db) {
-            error_no = UNINITIALIZED_ERROR;
-            exec_lock->unlock(); // unlock exec
+    /**
+     * Execute query and return its rows, the result of the last query shared by copies is not changed
+     *
+     * Threads using copies of this object get their own result, no other execute can replace it
+     * @param query
+     * @param rows set to the result of query, also upon failure
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute(SQLITE3_QUERY &query, std::shared_ptr<const SQLITE3_RESULT> &rows) {
+        EXECUTION execution(ROW_RESULT, false);
+        int rc = execute_query(query, execution);
+        rows = execution.rows ? execution.rows : empty_rows();
+        return rc;
+    }
 
-            return 1;
-        }
+    /**
+     * Execute query and return its columns, the result of the last query shared by copies is not changed
+     * @param query
+     * @param columns set to the result of query, also upon failure
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute(SQLITE3_QUERY &query, std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> &columns) {
+        EXECUTION execution(COLUMNAR_RESULT, false);
+        int rc = execute_query(query, execution);
+        columns = execution.columns ? execution.columns : empty_columns();
+        return rc;
+    }
 
-        // get query from SQLITE3_QUERY
-        std::string prepared_query;
-        try {
-            prepared_query = query.bind().bound_query;
-        } catch (std::out_of_range &e) {
-            error_no = QUERY_BINDING_ERROR;
-            exec_lock->unlock(); // unlock exec
+    /**
+     * Execute query
+     * @param query
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute(std::string &query) {
+        return execute(query.c_str());
+    }
 
-            return 1;
+    /**
+     * Execute query
+     * @param query
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute(const char *query) {
+        EXECUTION execution(result_mode, true);
+        int rc = execute_sql(query, execution);
+        publish(execution);
+        return rc;
+    }
+
+    /**
+     * Execute query and return its rows, the result of the last query shared by copies is not changed
+     * @param query
+     * @param rows set to the result of query, also upon failure
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute(const std::string &query, std::shared_ptr<const SQLITE3_RESULT> &rows) {
+        EXECUTION execution(ROW_RESULT, false);
+        int rc = execute_sql(query.c_str(), execution);
+        rows = execution.rows ? execution.rows : empty_rows();
+        return rc;
+    }
+
+    /**
+     * Execute query and return its columns, the result of the last query shared by copies is not changed
+     * @param query
+     * @param columns set to the result of query, also upon failure
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute(const std::string &query, std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> &columns) {
+        EXECUTION execution(COLUMNAR_RESULT, false);
+        int rc = execute_sql(query.c_str(), execution);
+        columns = execution.columns ? execution.columns : empty_columns();
+        return rc;
+    }
+
+    /**
+     * Run query and return a cursor over its rows, rows are read one at a time and not stored
+     *
+     * The cursor holds no lock, other queries can run while it is open
+     * @param query
+     * @return cursor, check error_no of the cursor upon failure
+     */
+    SQLITE3_CURSOR query(SQLITE3_QUERY &query) {
+        // check if database connection is open
+        if (!*db) {
+            return SQLITE3_CURSOR(UNINITIALIZED_ERROR, "No database connected");
         }
 
-        // clear result and column vector
-        result->clear();
-        column_name->clear();
+        // get prepared statement from cache, bindings only map to anonymous ? parameters
+        sqlite3_stmt *stmt = stmt_cache->acquire(*db, query.query_template);
+        if (stmt && !has_anonymous_parameters(stmt)) {
+            stmt_cache->release(query.query_template, stmt);
+            return SQLITE3_CURSOR(QUERY_BINDING_ERROR, "Query Binding Failed");
+        }
 
-        // run query
-        auto data_pack = Callback_Data(column_name, result);
-        int rc = sqlite3_exec(*db, prepared_query.c_str(), &exec_callback, &data_pack, err_msg.get());
-        if (rc != SQLITE_OK) { // check for error
-            // copy error message or get error message
-            if (*err_msg) {
-                err_msg_str = std::string(*err_msg);
-                sqlite3_free(*err_msg);
-            } else {
-                err_msg_str = std::string(sqlite3_errmsg(*db));
+        // fall back to the bound query if the template is not a single statement
+        if (!stmt) {
+            std::string prepared_query;
+            try {
+                prepared_query = query.bind().bound_query;
+            } catch (std::out_of_range &e) {
+                return SQLITE3_CURSOR(QUERY_BINDING_ERROR, "Query Binding Failed");
             }
 
-            error_no = EXECUTION_ERROR;
+            return prepare_cursor(prepared_query, false);
+        }
+
+        // bind values, the cursor may outlive query
+        int param_count = sqlite3_bind_parameter_count(stmt);
+        if (param_count > (int) query.binding.size()) {
+            stmt_cache->release(query.query_template, stmt);
+            return SQLITE3_CURSOR(QUERY_BINDING_ERROR, "Query Binding Failed");
+        }
+        bind_values(stmt, query, param_count, SQLITE_TRANSIENT);
 
-            exec_lock->unlock(); // unlock exec
+        return SQLITE3_CURSOR(db, stmt_cache, query.query_template, stmt);
+    }
 
-            return 1;
+    /**
+     * Run query and return a cursor over its rows, only the first statement of query is run
+     * @param query
+     * @return cursor, check error_no of the cursor upon failure
+     */
+    SQLITE3_CURSOR query(const std::string &query) {
+        // check if database connection is open
+        if (!*db) {
+            return SQLITE3_CURSOR(UNINITIALIZED_ERROR, "No database connected");
         }
 
-        exec_lock->unlock(); // unlock exec
-        return 0;
+        return prepare_cursor(query, true);
     }
 
     /**
-     * Execute query
+     * Run query and return a cursor over its rows, only the first statement of query is run
      * @param query
-     * @return 0 upon success, 1 upon failure
+     * @return cursor, check error_no of the cursor upon failure
      */
-    int execute(std::string &query) {
-        exec_lock->lock(); // lock exec
+    SQLITE3_CURSOR query(const char *query) {
+        return this->query(std::string(query));
+    }
 
+    /**
+     * Open a BLOB or TEXT cell for incremental reading and writing
+     *
+     * Use it to read byte ranges of large values without loading the row, or to fill a cell
+     * inserted with SQLITE3_QUERY::add_zeroblob_binding. A writable handle fails on tables
+     * with indexes on the column.
+     * @param table name of the table
+     * @param column name of the column
+     * @param rowid rowid of the row
+     * @param writable true to allow write()
+     * @param schema "main", "temp" or the name of an attached database
+     * @return blob handle, check error_no of the handle upon failure
+     */
+    SQLITE3_BLOB open_blob(const std::string &table, const std::string &column, int64_t rowid,
+                           bool writable = false, const std::string &schema = "main") {
         // check if database connection is open
         if (!*db) {
-            error_no = UNINITIALIZED_ERROR;
-            exec_lock->unlock(); // unlock exec
+            return SQLITE3_BLOB(UNINITIALIZED_ERROR, "No database connected");
+        }
 
-            return 1;
+        DB_LOCK lock(*db);
+        sqlite3_blob *blob = nullptr;
+        int rc = sqlite3_blob_open(*db, schema.c_str(), table.c_str(), column.c_str(), (sqlite3_int64) rowid,
+                                   writable ? 1 : 0, &blob);
+        if (rc != SQLITE_OK) { // check for error
+            std::string message = sqlite3_errmsg(*db);
+            sqlite3_blob_close(blob);
+            return SQLITE3_BLOB(EXECUTION_ERROR, message);
         }
 
-        // clear result and column vector
-        result->clear();
-        column_name->clear();
+        return SQLITE3_BLOB(db, blob, table, writable ? result_cache : nullptr);
+    }
 
-        // run query
-        auto data_pack = Callback_Data(column_name, result);
-        int rc = sqlite3_exec(*db, query.c_str(), &exec_callback, &data_pack, err_msg.get());
+    /**
+     * Copy the database into a file while it stays in use
+     *
+     * Pages are copied a few at a time with sqlite3_backup_step. The lock is released between
+     * steps, so this object keeps running queries and other connections keep writing. Changes
+     * made through this connection are copied as the backup goes, a commit from another
+     * connection restarts it. Changes of this connection must be committed before the backup,
+     * changes made during the backup wait for their commit. A step finding the database locked
+     * is retried until the timeout of set_busy_backoff is used up, then the backup fails.
+     * @param path file to write, created or replaced
+     * @param pages_per_step pages copied per step, -1 copies everything in one step
+     * @param sleep pause between steps
+     * @return 0 upon success, 1 upon failure
+     */
+    int backup_to(const std::string &path, int pages_per_step = 100,
+                  std::chrono::milliseconds sleep = std::chrono::milliseconds(10)) {
+        sqlite3 *target = nullptr;
+        int rc = sqlite3_open_v2(path.c_str(), &target, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
         if (rc != SQLITE_OK) { // check for error
-            // copy error message or get error message
-            if (*err_msg) {
-                err_msg_str = std::string(*err_msg);
-                sqlite3_free(*err_msg);
-            } else {
-                err_msg_str = std::string(sqlite3_errmsg(*db));
-            }
-
+            err_msg_str = target ? sqlite3_errmsg(target) : sqlite3_errstr(rc);
+            sqlite3_close(target);
             error_no = EXECUTION_ERROR;
+            return 1;
+        }
+
+        rc = run_backup(target, pages_per_step, sleep);
+        sqlite3_close(target);
+        return rc;
+    }
 
-            exec_lock->unlock(); // unlock exec
+    /**
+     * Copy the database into the database of another SQLITE3 while it stays in use
+     *
+     * Works as backup_to(path). The uncommitted changes of the target are committed first and
+     * then replaced. The target is only locked during each step, statements run on it between
+     * steps see a partial copy and it must not be committed before the backup is done. Copying
+     * a file into an in-memory database loads it for fast reads.
+     * @param target open database to overwrite, not a copy of this object
+     * @param pages_per_step pages copied per step, -1 copies everything in one step
+     * @param sleep pause between steps
+     * @return 0 upon success, 1 upon failure
+     */
+    int backup_to(SQLITE3 &target, int pages_per_step = 100,
+                  std::chrono::milliseconds sleep = std::chrono::milliseconds(10)) {
+        if (target.db == db || (*db && *target.db == *db)) {
+            err_msg_str = "Cannot back up a database into itself";
+            error_no = EXECUTION_ERROR;
+            return 1;
+        }
 
+        // check if the target is open
+        if (!*target.db) {
+            error_no = UNINITIALIZED_ERROR;
             return 1;
         }
 
-        exec_lock->unlock(); // unlock exec
-        return 0;
+        // the destination cannot be in a transaction
+        int rc = 0;
+        {
+            DB_LOCK lock(*target.db);
+            if (!sqlite3_get_autocommit(*target.db) &&
+                sqlite3_exec(*target.db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+                err_msg_str = std::string(sqlite3_errmsg(*target.db));
+                error_no = EXECUTION_ERROR;
+                rc = 1;
+            }
+        }
+
+        if (!rc) {
+            rc = run_backup(*target.db, pages_per_step, sleep);
+        }
+
+        // the content of the target changed under its caches
+        DB_LOCK lock(*target.db);
+        target.result_cache->clear();
+        target.start_transaction();
+        return rc;
     }
 
     /**
-     * Execute query
-     * @param query
+     * Copy the database into an in-memory image
+     *
+     * The image is the content of a database file, including the uncommitted changes of this
+     * connection. It can be written to disk as is or loaded into another connection with deserialize()
+     * @param image set to the bytes of the database
+     * @param schema "main", "temp" or the name of an attached database
      * @return 0 upon success, 1 upon failure
      */
-    int execute(const char *query) {
-        exec_lock->lock(); // lock exec
-
+    int serialize(std::string &image, const std::string &schema = "main") {
         // check if database connection is open
         if (!*db) {
             error_no = UNINITIALIZED_ERROR;
-            exec_lock->unlock(); // unlock exec
+            return 1;
+        }
 
+        DB_LOCK lock(*db);
+        sqlite3_int64 size = -1;
+        unsigned char *bytes = sqlite3_serialize(*db, schema.c_str(), &size, 0);
+        if (!bytes && size != 0) { // check for error, an empty database has no bytes
+            err_msg_str = "Unable to serialize database " + schema;
+            error_no = EXECUTION_ERROR;
             return 1;
         }
 
-        // clear result and column vector
-        result->clear();
-        column_name->clear();
+        image.assign(bytes ? reinterpret_cast<const char *>(bytes) : "", (size_t) size);
+        sqlite3_free(bytes);
 
-        // run query
-        auto data_pack = Callback_Data(column_name, result);
-        int rc = sqlite3_exec(*db, query, &exec_callback, &data_pack, err_msg.get());
-        if (rc != SQLITE_OK) { // check for error
-            // copy error message or get error message
-            if (*err_msg) {
-                err_msg_str = std::string(*err_msg);
-                sqlite3_free(*err_msg);
-            } else {
-                err_msg_str = std::string(sqlite3_errmsg(*db));
-            }
+        return 0;
+    }
 
-            error_no = EXECUTION_ERROR;
+    /**
+     * Replace a database of this connection by an in-memory copy of image
+     *
+     * The database file is not touched, following queries read and write the copy. Uncommitted
+     * changes are discarded.
+     * @param image bytes of a database file, e.g. from serialize()
+     * @param read_only true to reject writes, false to let the copy grow
+     * @param schema "main", "temp" or the name of an attached database
+     * @return 0 upon success, 1 upon failure
+     */
+    int deserialize(const std::string &image, bool read_only = false, const std::string &schema = "main") {
+        // check if database connection is open
+        if (!*db) {
+            error_no = UNINITIALIZED_ERROR;
+            return 1;
+        }
 
-            exec_lock->unlock(); // unlock exec
+        // statements of other threads wait until the copy is in place
+        DB_LOCK lock(*db);
 
-            return 1;
+        // a database in a transaction cannot be replaced
+        if (!sqlite3_get_autocommit(*db)) {
+            sqlite3_exec(*db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        }
+        stmt_cache->clear();
+
+        // SQLite owns the copy and frees it upon failure or close
+        auto *bytes = reinterpret_cast<unsigned char *>(sqlite3_malloc64(image.empty() ? 1 : image.size()));
+        int rc = SQLITE_NOMEM;
+        if (bytes) {
+            memcpy(bytes, image.data(), image.size());
+            rc = sqlite3_deserialize(*db, schema.c_str(), bytes, (sqlite3_int64) image.size(),
+                                     (sqlite3_int64) image.size(), SQLITE_DESERIALIZE_FREEONCLOSE |
+                                                                   (read_only ? SQLITE_DESERIALIZE_READONLY
+                                                                              : SQLITE_DESERIALIZE_RESIZEABLE));
+        }
+        if (rc != SQLITE_OK) { // check for error
+            err_msg_str = std::string(sqlite3_errmsg(*db));
+            error_no = EXECUTION_ERROR;
         }
 
-        exec_lock->unlock(); // unlock exec
-        return 0;
+        result_cache->clear();
+        start_transaction();
+
+        return rc == SQLITE_OK ? 0 : 1;
     }
 
     /**
-     * Return the a copy of the column names for the result of the last query
-     * @return shared pointer pointing to a copy of the column name
+     * Run query and read every row into a T, columns are mapped to members by SQLITE3_ROW_MAPPING<T>
+     *
+     * Values are read with the sqlite3_column_* function matching the member type, column types
+     * are checked once before the first row.
+     * @tparam T default constructible struct with a SQLITE3_ROW_MAPPING specialization
+     * @param query
+     * @param rows rows are appended to rows
+     * @return 0 upon success, 1 upon failure
      */
-    std::shared_ptr<SQLITE_ROW_VECTOR> copy_column_names() const {
-        exec_lock->lock(); // lock exec
-
-        // make copy of result
-        auto ret = std::make_shared<SQLITE_ROW_VECTOR>();
-        std::copy(column_name->begin(), column_name->end(), std::back_inserter(*ret));
+    template<typename T>
+    int query_as(SQLITE3_QUERY &query, std::vector<T> &rows) {
+        DEADLINE deadline(query_timeout);
+        return read_rows(this->query(query), rows);
+    }
 
-        exec_lock->unlock(); // unlock exec
+    /**
+     * Run query and read every row into a T, columns are mapped to members by SQLITE3_ROW_MAPPING<T>
+     * @tparam T default constructible struct with a SQLITE3_ROW_MAPPING specialization
+     * @param query
+     * @param rows rows are appended to rows
+     * @return 0 upon success, 1 upon failure
+     */
+    template<typename T>
+    int query_as(const std::string &query, std::vector<T> &rows) {
+        DEADLINE deadline(query_timeout);
+        return read_rows(this->query(query), rows);
+    }
 
-        return ret;
+    /**
+     * Return the column names for the result of the last query
+     *
+     * The names are shared with the result, nothing is copied and no lock is taken, the rows
+     * are not built
+     * @return shared pointer pointing to the column names
+     */
+    std::shared_ptr<const SQLITE_ROW_VECTOR> copy_column_names() const {
+        auto snapshot = get_row_result();
+        return std::shared_ptr<const SQLITE_ROW_VECTOR>(snapshot, &snapshot->get_column_names());
     }
 
     /**
@@ -349,7 +662,7 @@ public:
      * @return number of col
      */
     int get_result_col_count() const {
-        return result->at(0).size();
+        return get_row_result()->column_count();
     }
 
     /**
@@ -357,34 +670,71 @@ public:
      * @return number of row
      */
     int get_result_row_count() const {
-        return result->size();
+        return get_row_result()->row_count();
+    }
+
+    /**
+     * Return the result of the last query
+     *
+     * The first call builds a std::string for every cell of the result, which adds up to half the
+     * run time of the query (see the "copy_result() cold" benchmark). From then on, queries of this
+     * object and its copies build the rows before publishing their result, so later calls only
+     * share them. Read cells with get_row_result()->get_text() to skip building them.
+     * @return shared pointer pointing to the rows
+     */
+    std::shared_ptr<const std::vector<SQLITE_ROW_VECTOR>> copy_result() const {
+        result_arena->build_rows = true;
+        auto snapshot = get_row_result();
+        return std::shared_ptr<const std::vector<SQLITE_ROW_VECTOR>>(snapshot, &snapshot->get_rows());
     }
 
     /**
-     * Return the a copy of the result of the last query
-     * @return shared pointer pointing to a copy of the result
+     * Return the result of the last query executed in ROW_RESULT mode, with its column names
+     *
+     * The returned result is never modified, a new one is created for every query
+     * @return shared pointer to the result, empty in COLUMNAR_RESULT mode
      */
-    std::shared_ptr<std::vector<SQLITE_ROW_VECTOR>> copy_result() const {
-        exec_lock->lock(); // lock exec
+    std::shared_ptr<const SQLITE3_RESULT> get_row_result() const {
+        return std::atomic_load(result.get());
+    }
 
-        // make copy of result
-        auto ret = std::make_shared<std::vector<SQLITE_ROW_VECTOR>>();
-        std::copy(result->begin(), result->end(), std::back_inserter(*ret));
+    /**
+     * Set how the result of following queries is stored
+     * @param mode ROW_RESULT (default) fills the row result, COLUMNAR_RESULT fills the columnar result
+     */
+    void set_result_mode(SQLITE3_RESULT_MODE mode) {
+        result_mode = mode;
+    }
 
-        exec_lock->unlock(); // unlock exec
+    /**
+     * Get how the result of queries is stored
+     * @return result mode
+     */
+    SQLITE3_RESULT_MODE get_result_mode() const {
+        return result_mode;
+    }
 
-        return ret;
+    /**
+     * Return the result of the last query executed in COLUMNAR_RESULT mode
+     *
+     * The returned result is never modified, a new one is created for every query
+     * @return shared pointer to the columnar result, empty in ROW_RESULT mode
+     */
+    std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> get_columnar_result() const {
+        return std::atomic_load(columnar_result.get());
     }
 
     /**
-     * @deprecated Deprecated due to possibility of unsafe memory access
+     * @deprecated Use get_row_result() or copy_result()
      *
-     * Return the result of a query
-     * @return pointer to
+     * Return the result of a query, this object holds it until the next call of get_result().
+     * Not safe to call from several threads on the same object
+     * @return pointer to the rows, valid until the next call or the destruction of this object
      */
     [[deprecated]]
     const std::vector<SQLITE_ROW_VECTOR> *get_result() const {
-        return result.get();
+        held_result = get_row_result();
+        return &held_result->get_rows();
     }
 
     /**
@@ -403,7 +753,7 @@ public:
         std::cout << std::endl;
 
         // print rows
-        for (SQLITE_ROW_VECTOR &row : *result_copy) {
+        for (const SQLITE_ROW_VECTOR &row : *result_copy) {
             std::cout << "|";
             for (auto &col : row) {
                 std::cout << col << "|";
@@ -442,6 +792,12 @@ public:
             case EXECUTION_ERROR:
                 std::cerr << err_msg_str << std::endl;
                 break;
+            case TIMEOUT_ERROR:
+                std::cerr << "Query timed out\n";
+                break;
+            case CANCELLED_ERROR:
+                std::cerr << "Query cancelled\n";
+                break;
         }
 
         error_no = NO_ERROR;
@@ -450,76 +806,1387 @@ public:
     /**
      * Add simple user defined function to database
      * @param name name of function
-     * @param argc number of argument a function take
-     * @param lambda function implementation
+     * @param argc number of argument a function take, -1 for any
+     * @param lambda function implementation, may capture state, it is destroyed with the connection
      * @lambda_arg void (sqlite3_context* context, int argc, sqlite3_value** value)
+     * @param flags SQLITE_DETERMINISTIC, SQLITE_INNOCUOUS, SQLITE_DIRECTONLY or 0
      * @return 0 upon success, 1 upon failure
      */
-    int add_function(const std::string &name, int argc, void (*lambda)(sqlite3_context *, int, sqlite3_value **)) {
-        // add function to database
-        int rc = sqlite3_create_function(*db,
-                                         name.c_str(),
-                                         argc, SQLITE_UTF8,
-                                         nullptr,
-                                         lambda,
-                                         nullptr,
-                                         nullptr);
-
-        // check success
-        if (rc != SQLITE_OK) {
-            error_no = EXECUTION_ERROR;
-            err_msg_str = sqlite3_errmsg(*db);
-            return 1;
-        }
-
-        return 0;
+    int add_function(const std::string &name, int argc, SQLITE3_FUNCTION::RAW_FUNCTION lambda, int flags = 0) {
+        DB_LOCK lock(*db);
+        return check_function(SQLITE3_FUNCTION::create_raw(*db, name, argc, std::move(lambda), flags), name, flags);
     }
 
-private:
     /**
-     * Begin a new transaction
+     * Add user defined function with typed arguments to database
+     *
+     * Arguments are converted from SQL values to the parameter types of function and its result
+     * back to a SQL value. Supported types are integral, floating point, std::string,
+     * std::vector<uint8_t> (blob) and sqlite3_value * for arguments, void and nullptr_t return NULL.
+     * An exception thrown by function fails the query with its message.
+     * @code
+     * db.add_function("discount", [rate](double price, int64_t quantity) {
+     *     return quantity > 10 ? price * (1 - rate) : price;
+     * }, SQLITE_DETERMINISTIC);
+     * @endcode
+     * @tparam F lambda, function object or function pointer
+     * @param name name of function
+     * @param function function implementation, it is destroyed with the connection
+     * @param flags SQLITE_DETERMINISTIC, SQLITE_INNOCUOUS, SQLITE_DIRECTONLY or 0
      * @return 0 upon success, 1 upon failure
      */
-    int start_transaction() {
-        int rc = sqlite3_exec(*db, "BEGIN;", nullptr, nullptr, err_msg.get());
-        if (rc != SQLITE_OK) { // check for error
-            // copy error message and free memory
-            err_msg_str = std::string(*err_msg);
-            sqlite3_free(*err_msg);
-            error_no = EXECUTION_ERROR;
+    template<typename F>
+    int add_function(const std::string &name, F function, int flags = 0) {
+        typename SQLITE3_CALLABLE<F>::FUNCTION typed(std::move(function));
+        DB_LOCK lock(*db);
+        return check_function(SQLITE3_FUNCTION::create_scalar(*db, name, std::move(typed), flags), name, flags);
+    }
 
-            return 1;
+    /**
+     * Add user defined aggregate function to database
+     *
+     * An AGGREGATE is constructed for each group, step() is called with the arguments of
+     * every row and final() returns the result. Arguments and results are converted as
+     * for typed functions.
+     * @code
+     * struct GEOMETRIC_MEAN {
+     *     double log_sum = 0;
+     *     int64_t count = 0;
+     *     void step(double value) { log_sum += std::log(value); count += 1; }
+     *     double final() { return count ? std::exp(log_sum / count) : 0; }
+     * };
+     * db.add_aggregate<GEOMETRIC_MEAN>("geometric_mean", SQLITE_DETERMINISTIC);
+     * @endcode
+     * @tparam AGGREGATE default constructible class with void step(args...) and result final()
+     * @param name name of function
+     * @param flags SQLITE_DETERMINISTIC, SQLITE_INNOCUOUS, SQLITE_DIRECTONLY or 0
+     * @return 0 upon success, 1 upon failure
+     */
+    template<typename AGGREGATE>
+    int add_aggregate(const std::string &name, int flags = 0) {
+        DB_LOCK lock(*db);
+        return check_function(SQLITE3_FUNCTION::create_aggregate<AGGREGATE>(*db, name, flags), name, flags);
+    }
+
+    /**
+     * Add user defined aggregate window function to database
+     *
+     * Works as add_aggregate, it can also be used with an OVER clause: inverse() removes
+     * the arguments of a row leaving the window and value() returns the result of the
+     * current window.
+     * @tparam AGGREGATE default constructible class with void step(args...), void inverse(args...),
+     *                   result value() and result final()
+     * @param name name of function
+     * @param flags SQLITE_DETERMINISTIC, SQLITE_INNOCUOUS, SQLITE_DIRECTONLY or 0
+     * @return 0 upon success, 1 upon failure
+     */
+    template<typename AGGREGATE>
+    int add_window_function(const std::string &name, int flags = 0) {
+        DB_LOCK lock(*db);
+        return check_function(SQLITE3_FUNCTION::create_window<AGGREGATE>(*db, name, flags), name, flags);
+    }
+
+    /**
+     * Expose a vector of structs as a read-only table, rows are read in place and never copied
+     *
+     * Columns are the members listed by SQLITE3_ROW_MAPPING<T>, the rowid is the position in the
+     * vector. The table needs no CREATE statement and is only visible to this connection. The
+     * vector must outlive the table and must not change while a query reads it, rows added
+     * between queries are seen by the next query. Constraints on the rowid and on sorted_by are
+     * answered by binary search, constraints on other columns are checked before a row reaches
+     * SQLite. Queries reading the table are never cached.
+     * @code
+     * db.add_vector_table("live_orders", orders, {"id", "price", "item"}, "id");
+     * db.execute("SELECT item FROM live_orders JOIN customers USING(id) WHERE id BETWEEN 10 AND 20;");
+     * @endcode
+     * @tparam T struct with a SQLITE3_ROW_MAPPING specialization
+     * @param name name of table, replaces a table added before under the same name
+     * @param rows rows of the table
+     * @param columns column names, one per mapped member
+     * @param sorted_by column the vector is sorted by in ascending order, empty if none
+     * @return 0 upon success, 1 upon failure
+     */
+    template<typename T>
+    int add_vector_table(const std::string &name, const std::vector<T> &rows, const std::vector<std::string> &columns,
+                         const std::string &sorted_by = "") {
+        const std::vector<T> *source = &rows;
+        return register_range_table<typename std::vector<T>::const_iterator>(
+                name, [source]() { return std::make_pair(source->cbegin(), source->cend()); }, columns, sorted_by);
+    }
+
+    /**
+     * Expose an iterator range of structs as a read-only table, works as add_vector_table
+     * @tparam ITERATOR random access iterator, e.g. of std::deque or std::array or a pointer
+     * @param name name of table, replaces a table added before under the same name
+     * @param begin first row, must stay valid as long as the table exists
+     * @param end past the last row
+     * @param columns column names, one per mapped member
+     * @param sorted_by column the range is sorted by in ascending order, empty if none
+     * @return 0 upon success, 1 upon failure
+     */
+    template<typename ITERATOR>
+    int add_range_table(const std::string &name, ITERATOR begin, ITERATOR end, const std::vector<std::string> &columns,
+                        const std::string &sorted_by = "") {
+        return register_range_table<ITERATOR>(name, [begin, end]() { return std::make_pair(begin, end); },
+                                              columns, sorted_by);
+    }
+
+    /**
+     * Insert rows produced by row_source into table
+     *
+     * Rows are inserted with one multi-row INSERT prepared once and sized to the
+     * bound parameter limit of the connection. All rows are inserted or none, the
+     * changes are part of the current transaction, call commit() to save them.
+     * @param table name of table
+     * @param columns names of the columns to insert
+     * @param row_source called with an empty query for each row, adds one binding per column
+     *                   and returns true, or returns false when there are no more rows
+     * @param rebuild_indexes drop the secondary indexes of table before the load and recreate them after
+     * @return 0 upon success, 1 upon failure
+     */
+    int bulk_insert(const std::string &table, const std::vector<std::string> &columns,
+                    const std::function<bool(SQLITE3_QUERY &)> &row_source, bool rebuild_indexes = false) {
+        DEADLINE deadline(query_timeout);
+
+        // check if database connection is open
+        if (!*db) {
+            error_no = UNINITIALIZED_ERROR;
+
+            return 1;
+        }
+        if (columns.empty()) {
+            error_no = QUERY_BINDING_ERROR;
+
+            return 1;
+        }
+
+        // other threads wait for the load, a rollback must not undo their changes
+        DB_LOCK lock(*db);
+        clear_results();
+        if (run_plain("SAVEPOINT bulk_insert;")) {
+            return 1;
+        }
+
+        int rc = check_interrupt(load_rows(table, columns, row_source, rebuild_indexes));
+
+        // undo everything upon failure, keep the error of the load
+        if (rc) {
+            sqlite3_exec(*db, "ROLLBACK TO bulk_insert; RELEASE bulk_insert;", nullptr, nullptr, nullptr);
+        } else if (run_plain("RELEASE bulk_insert;")) {
+            rc = 1;
+        }
+
+        // rows of WITHOUT ROWID tables are not reported by the update hook
+        if (result_cache->is_enabled()) {
+            result_cache->invalidate(table);
+        }
+
+        return rc;
+    }
+
+    /**
+     * Set the time limit of each following call of this object, a call running longer fails with TIMEOUT_ERROR
+     *
+     * The time spent waiting for other threads using the same connection counts against the limit
+     * @param timeout time limit, 0 (default) for no limit
+     */
+    void set_query_timeout(std::chrono::milliseconds timeout) {
+        query_timeout = timeout;
+    }
+
+    /**
+     * Get the time limit of each call
+     * @return time limit, 0 for no limit
+     */
+    std::chrono::milliseconds get_query_timeout() const {
+        return query_timeout;
+    }
+
+    /**
+     * Wait for locks held by other connections with exponential backoff and jitter
+     *
+     * Replaces the busy timeout of SQLITE3_OPTIONS, see SQLITE3_BUSY_HANDLER
+     * @param initial_delay first sleep
+     * @param max_delay longest sleep
+     * @param timeout total sleep time after which a statement fails
+     * @return 0 upon success, 1 upon failure
+     */
+    int set_busy_backoff(std::chrono::microseconds initial_delay = std::chrono::milliseconds(1),
+                         std::chrono::microseconds max_delay = std::chrono::milliseconds(100),
+                         std::chrono::microseconds timeout = std::chrono::seconds(5)) {
+        // check if database connection is open
+        if (!*db) {
+            error_no = UNINITIALIZED_ERROR;
+            return 1;
+        }
+
+        DB_LOCK lock(*db);
+        busy_handler->configure(initial_delay, max_delay, timeout);
+        if (busy_handler->attach(*db, true) != SQLITE_OK) {
+            record_error(sqlite3_errcode(*db));
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * Wait for locks held by other connections with sqlite3_busy_timeout, removes the backoff
+     * @param timeout time to wait, 0 fails at once
+     * @return 0 upon success, 1 upon failure
+     */
+    int set_busy_timeout(std::chrono::milliseconds timeout) {
+        // check if database connection is open
+        if (!*db) {
+            error_no = UNINITIALIZED_ERROR;
+            return 1;
+        }
+
+        DB_LOCK lock(*db);
+        if (busy_handler->attach(*db, false, (int) timeout.count()) != SQLITE_OK) {
+            record_error(sqlite3_errcode(*db));
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * Set how many times commit() runs COMMIT again after SQLITE_BUSY, sleeping with the backoff
+     * of set_busy_backoff in between. All attempts together take at most the timeout of set_busy_backoff
+     * @param retries number of retries, 3 by default
+     */
+    void set_commit_retries(int retries) {
+        commit_retries = retries > 0 ? retries : 0;
+    }
+
+    /**
+     * Get how many times commit() runs COMMIT again after SQLITE_BUSY
+     * @return number of retries
+     */
+    int get_commit_retries() const {
+        return commit_retries;
+    }
+
+    /**
+     * Get the contention statistics of this connection
+     * @return statistics
+     */
+    SQLITE3_BUSY_STATS get_busy_stats() const {
+        return busy_handler->get_stats();
+    }
+
+    /**
+     * Interrupt the statements running on this connection, can be called from any thread
+     *
+     * Interrupted calls fail with CANCELLED_ERROR. Must not be called while the connection is being closed.
+     */
+    void cancel() {
+        sqlite3 *handle = *db;
+        if (handle) {
+            sqlite3_interrupt(handle);
+        }
+    }
+
+    /**
+     * Get the number of calls that failed with TIMEOUT_ERROR
+     * @return number of timed out calls
+     */
+    uint64_t get_timeout_count() const {
+        return interrupts->timeouts;
+    }
+
+    /**
+     * Get the number of calls that failed with CANCELLED_ERROR
+     * @return number of cancelled calls
+     */
+    uint64_t get_cancel_count() const {
+        return interrupts->cancellations;
+    }
+
+    /**
+     * Start or stop collecting per statement statistics with sqlite3_trace_v2
+     * @param enable true to start, false to stop
+     * @return 0 upon success, 1 upon failure
+     */
+    int enable_profiling(bool enable = true) {
+        // check if database connection is open
+        if (!*db) {
+            error_no = UNINITIALIZED_ERROR;
+            return 1;
+        }
+
+        if (profiler->attach(*db, enable)) {
+            error_no = EXECUTION_ERROR;
+            err_msg_str = sqlite3_errmsg(*db);
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * Get the profiler of this connection, for statistics, JSON dumps and the slow query callback
+     * @return profiler
+     */
+    std::shared_ptr<SQLITE3_PROFILER> get_profiler() const {
+        return profiler;
+    }
+
+    /**
+     * Set the number of prepared statements kept by the statement cache
+     * @param capacity maximum number of cached statements, 0 disables caching
+     */
+    void set_stmt_cache_capacity(size_t capacity) {
+        stmt_cache->set_capacity(capacity);
+    }
+
+    /**
+     * Get the number of prepared statements kept by the statement cache
+     * @return capacity of the statement cache
+     */
+    size_t get_stmt_cache_capacity() const {
+        return stmt_cache->get_capacity();
+    }
+
+    /**
+     * Get the number of executions that reused a cached prepared statement
+     * @return statement cache hits
+     */
+    uint64_t get_stmt_cache_hits() const {
+        return stmt_cache->get_hits();
+    }
+
+    /**
+     * Get the number of executions that had to prepare a statement
+     * @return statement cache misses
+     */
+    uint64_t get_stmt_cache_misses() const {
+        return stmt_cache->get_misses();
+    }
+
+    /**
+     * Set the memory budget of the result cache
+     *
+     * Results of read-only queries are cached until a table they were read from changes, a repeated
+     * query then returns its result without running. Changes to WITHOUT ROWID tables are only
+     * noticed when made with execute() or bulk_insert().
+     * @param bytes approximate memory the cached results may use, 0 (default) disables the cache
+     */
+    void set_result_cache_budget(size_t bytes) {
+        DB_LOCK lock(*db);
+        bool was_enabled = result_cache->is_enabled();
+        result_cache->set_budget(bytes);
+        if (*db && bytes && !was_enabled) {
+            result_cache->attach(*db);
+        } else if (*db && !bytes && was_enabled) {
+            SQLITE3_RESULT_CACHE::detach(*db);
+            result_cache->clear();
+        }
+    }
+
+    /**
+     * Get the result cache, for its hit rate and memory usage
+     * @return result cache
+     */
+    std::shared_ptr<const SQLITE3_RESULT_CACHE> get_result_cache() const {
+        return result_cache;
+    }
+
+    /**
+     * Set how much memory the storage of a row result keeps for the next query
+     *
+     * The storage of the previous result is reused when nobody holds that result anymore,
+     * it keeps its capacity up to this limit and is released above it.
+     * @param bytes capacity kept between queries, SIZE_MAX (default) keeps everything, 0 keeps nothing
+     */
+    void set_result_arena_limit(size_t bytes) {
+        result_arena->max_capacity = bytes;
+        auto spare = std::atomic_exchange(&result_arena->spare, std::shared_ptr<SQLITE3_RESULT>());
+        if (spare) {
+            spare->reset(bytes);
+            std::atomic_store(&result_arena->spare, spare);
+        }
+    }
+
+    /**
+     * Get how much memory the storage of a row result keeps for the next query
+     * @return capacity kept between queries in bytes
+     */
+    size_t get_result_arena_limit() const {
+        return result_arena->max_capacity;
+    }
+
+private:
+    /**
+     * Settings and results of one call of execute, each call has its own so calls of different
+     * threads do not overwrite each other's result
+     */
+    struct EXECUTION {
+        EXECUTION(SQLITE3_RESULT_MODE mode, bool publish) : mode(mode), publish(publish) {}
+
+        SQLITE3_RESULT_MODE mode; // how rows are collected
+        bool publish; // store the result for get_result() and friends once done
+        std::shared_ptr<const SQLITE3_RESULT> rows;
+        std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> columns;
+    };
+
+    /**
+     * Hold the mutex sqlite keeps for a connection opened with SQLITE_OPEN_FULLMUTEX, so that
+     * several calls and the error message they leave are not interleaved with other threads
+     */
+    struct DB_LOCK {
+        explicit DB_LOCK(sqlite3 *handle) : mutex(handle ? sqlite3_db_mutex(handle) : nullptr) {
+            sqlite3_mutex_enter(mutex);
+        }
+
+        ~DB_LOCK() {
+            sqlite3_mutex_leave(mutex);
+        }
+
+        DB_LOCK(const DB_LOCK &) = delete;
+        DB_LOCK &operator=(const DB_LOCK &) = delete;
+
+        sqlite3_mutex *mutex;
+    };
+
+    /**
+     * Body of execute(SQLITE3_QUERY &)
+     * @param query
+     * @param execution receives the result
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute_query(SQLITE3_QUERY &query, EXECUTION &execution) {
+        DEADLINE deadline(query_timeout);
+
+        // check if database connection is open
+        if (!*db) {
+            error_no = UNINITIALIZED_ERROR;
+
+            return 1;
+        }
+
+        // answer repeated reads from the result cache, the lookup, the query and the store
+        // must not be interleaved with changes of other threads
+        bool caching = result_cache->is_enabled();
+        DB_LOCK lock(caching ? *db : nullptr);
+        std::string cache_key;
+        if (caching) {
+            cache_key = SQLITE3_RESULT_CACHE::key_of(query, (char) execution.mode);
+            if (load_cached_result(cache_key, execution)) {
+                return 0;
+            }
+        }
+
+        // get prepared statement from cache, bindings only map to anonymous ? parameters
+        sqlite3_stmt *stmt = stmt_cache->acquire(*db, query.query_template);
+        if (stmt && !has_anonymous_parameters(stmt)) {
+            stmt_cache->release(query.query_template, stmt);
+            error_no = QUERY_BINDING_ERROR;
+
+            return 1;
+        }
+
+        // fall back to the bound query if the template is not a single statement
+        if (!stmt) {
+            int rc = check_interrupt(execute_bound(query, execution));
+            if (caching) { // the template cannot be analyzed, drops every result
+                cache_result(std::string(), query.query_template, rc, execution);
+            }
+
+            return rc;
+        }
+
+        // bind values
+        int param_count = sqlite3_bind_parameter_count(stmt);
+        if (param_count > (int) query.binding.size()) {
+            stmt_cache->release(query.query_template, stmt);
+            error_no = QUERY_BINDING_ERROR;
+
+            return 1;
+        }
+        bind_values(stmt, query, param_count, SQLITE_STATIC);
+
+        // run query
+        begin_results(execution);
+        int rc = check_interrupt(run_statement(stmt, execution));
+        stmt_cache->release(query.query_template, stmt);
+        if (caching) {
+            cache_result(cache_key, query.query_template, rc, execution);
+        }
+
+        return rc;
+    }
+
+    /**
+     * Body of execute(const char *)
+     * @param query
+     * @param execution receives the result
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute_sql(const char *query, EXECUTION &execution) {
+        DEADLINE deadline(query_timeout);
+
+        // check if database connection is open
+        if (!*db) {
+            error_no = UNINITIALIZED_ERROR;
+
+            return 1;
+        }
+
+        // run query
+        if (!result_cache->is_enabled()) {
+            return check_interrupt(run_sql(query, execution));
+        }
+        return execute_cached(query, execution);
+    }
+
+    /**
+     * Execute query by splicing bindings into the template
+     * @param query
+     * @param execution receives the result
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute_bound(SQLITE3_QUERY &query, EXECUTION &execution) {
+        // get query from SQLITE3_QUERY
+        std::string prepared_query;
+        try {
+            prepared_query = query.bind().bound_query;
+        } catch (std::out_of_range &e) {
+            error_no = QUERY_BINDING_ERROR;
+            return 1;
+        }
+
+        return run_sql(prepared_query.c_str(), execution);
+    }
+
+    /**
+     * Run one or more SQL statements and collect the result according to the mode of execution
+     * @param sql
+     * @param execution receives the result
+     * @return 0 upon success, 1 upon failure
+     */
+    int run_sql(const char *sql, EXECUTION &execution) {
+        begin_results(execution);
+
+        if (execution.mode == COLUMNAR_RESULT) {
+            // run statements one by one, the last statement returning columns provides the result
+            while (sql && *sql) {
+                sqlite3_stmt *stmt = nullptr;
+                if (prepare(sql, -1, &stmt, &sql) != SQLITE_OK) { // check for error
+                    return 1;
+                }
+                if (!stmt) { // whitespace or comment
+                    continue;
+                }
+
+                int rc = run_statement(stmt, execution);
+                sqlite3_finalize(stmt);
+                if (rc) {
+                    return rc;
+                }
+            }
+            return 0;
+        }
+
+        // run statements one by one, rows of every statement are collected as sqlite3_exec would,
+        // values keep their length so blobs are not cut at the first NUL
+        auto rows = new_row_result();
+        int rc = SQLITE_OK;
+        while (rc == SQLITE_OK && sql && *sql) {
+            sqlite3_stmt *stmt = nullptr;
+            rc = prepare(sql, -1, &stmt, &sql);
+            if (rc == SQLITE_OK && stmt) {
+                rc = step_statement(stmt, *rows);
+            }
+            sqlite3_finalize(stmt);
+        }
+
+        // rows collected before a failure are kept
+        execution.rows = std::move(rows);
+        return rc == SQLITE_OK ? 0 : 1;
+    }
+
+    /**
+     * Step a prepared statement to completion and collect the result according to the mode of execution
+     * @param stmt prepared statement with all parameters bound
+     * @param execution receives the result
+     * @return 0 upon success, 1 upon failure
+     */
+    int run_statement(sqlite3_stmt *stmt, EXECUTION &execution) {
+        int rc;
+        if (execution.mode == COLUMNAR_RESULT) {
+            if (sqlite3_column_count(stmt) == 0) { // nothing to collect
+                while ((rc = step(stmt)) == SQLITE_ROW) {}
+            } else {
+                auto columns = std::make_shared<SQLITE3_COLUMNAR_RESULT>();
+                columns->reset(stmt);
+                while ((rc = step(stmt)) == SQLITE_ROW) {
+                    columns->append_row(stmt);
+                }
+                execution.columns = std::move(columns);
+            }
+            rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+        } else {
+            auto rows = new_row_result();
+            rc = step_statement(stmt, *rows);
+            execution.rows = std::move(rows);
+        }
+
+        return rc == SQLITE_OK ? 0 : 1;
+    }
+
+    /**
+     * Prepare a statement, the error message is recorded before other threads can replace it
+     * @return sqlite return code
+     */
+    int prepare(const char *sql, int bytes, sqlite3_stmt **stmt, const char **tail) {
+        DB_LOCK lock(*db);
+        int rc = sqlite3_prepare_v2(*db, sql, bytes, stmt, tail);
+        if (rc != SQLITE_OK) { // check for error
+            record_error(rc);
+        }
+        return rc;
+    }
+
+    /**
+     * Step a statement, the error message is recorded before other threads can replace it
+     * @return sqlite return code
+     */
+    int step(sqlite3_stmt *stmt) {
+        DB_LOCK lock(*db);
+        int rc = sqlite3_step(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) { // check for error
+            record_error(rc);
+        }
+        return rc;
+    }
+
+    /**
+     * Keep the error of the last failed call, the database mutex must be held
+     * @param rc sqlite return code
+     */
+    void record_error(int rc) {
+        err_msg_str = std::string(sqlite3_errmsg(*db));
+        error_code = rc;
+        error_no = EXECUTION_ERROR;
+    }
+
+    /**
+     * Run a statement without collecting results
+     * @param sql
+     * @return 0 upon success, 1 upon failure
+     */
+    int run_plain(const std::string &sql) {
+        DB_LOCK lock(*db);
+        char *err_msg = nullptr;
+        int rc = sqlite3_exec(*db, sql.c_str(), nullptr, nullptr, &err_msg);
+        if (rc != SQLITE_OK) { // check for error
+            // copy error message or get error message
+            if (err_msg) {
+                err_msg_str = std::string(err_msg);
+                sqlite3_free(err_msg);
+            } else {
+                err_msg_str = std::string(sqlite3_errmsg(*db));
+            }
+
+            error_code = rc;
+            error_no = EXECUTION_ERROR;
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * Quote a table or column name
+     * @param name
+     * @return name in double quotes
+     */
+    static std::string quote_identifier(const std::string &name) {
+        std::string quoted = "\"";
+        for (char c : name) {
+            quoted += c;
+            if (c == '"') {
+                quoted += '"';
+            }
+        }
+        return quoted + "\"";
+    }
+
+    /**
+     * Prepare an INSERT of row_count rows
+     * @param table name of table
+     * @param columns names of columns
+     * @param row_count number of rows in the VALUES clause
+     * @return prepared statement, nullptr upon failure
+     */
+    sqlite3_stmt *prepare_insert(const std::string &table, const std::vector<std::string> &columns,
+                                 size_t row_count) {
+        std::string row = "(?";
+        for (size_t i = 1; i < columns.size(); ++i) {
+            row += ",?";
+        }
+        row += ")";
+
+        std::string sql = "INSERT INTO " + quote_identifier(table) + " (";
+        for (size_t i = 0; i < columns.size(); ++i) {
+            sql += (i ? "," : "") + quote_identifier(columns[i]);
+        }
+        sql += ") VALUES ";
+        sql.reserve(sql.size() + row_count * (row.size() + 1));
+        for (size_t i = 0; i < row_count; ++i) {
+            sql += (i ? "," : "") + row;
+        }
+
+        sqlite3_stmt *stmt = nullptr;
+        if (prepare(sql.c_str(), (int) sql.size() + 1, &stmt, nullptr) != SQLITE_OK) {
+            sqlite3_finalize(stmt);
+            return nullptr;
+        }
+        return stmt;
+    }
+
+    /**
+     * Bind row_count buffered rows to an INSERT and run it
+     * @param stmt INSERT prepared by prepare_insert
+     * @param values buffered values, row after row
+     * @return 0 upon success, 1 upon failure
+     */
+    int insert_rows(sqlite3_stmt *stmt, const std::vector<SQLITE3_VALUE> &values) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            bind_value(stmt, (int) i + 1, values[i], SQLITE_STATIC);
+        }
+
+        int rc = step(stmt);
+        sqlite3_reset(stmt);
+        return rc == SQLITE_DONE ? 0 : 1;
+    }
+
+    /**
+     * Body of bulk_insert, runs inside the bulk_insert savepoint
+     * @return 0 upon success, 1 upon failure
+     */
+    int load_rows(const std::string &table, const std::vector<std::string> &columns,
+                  const std::function<bool(SQLITE3_QUERY &)> &row_source, bool rebuild_indexes) {
+        // collect and drop secondary indexes, automatic indexes have no sql and stay
+        std::vector<std::string> indexes;
+        if (rebuild_indexes) {
+            sqlite3_stmt *stmt = nullptr;
+            sqlite3_prepare_v2(*db, "SELECT name, sql FROM sqlite_master "
+                                    "WHERE type = 'index' AND tbl_name = ? AND sql IS NOT NULL;", -1, &stmt, nullptr);
+            sqlite3_bind_text(stmt, 1, table.c_str(), (int) table.size(), SQLITE_STATIC);
+            std::vector<std::string> names;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                names.emplace_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+                indexes.emplace_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1)));
+            }
+            sqlite3_finalize(stmt);
+
+            for (auto &name : names) {
+                if (run_plain("DROP INDEX " + quote_identifier(name) + ";")) {
+                    return 1;
+                }
+            }
+        }
+
+        // as many rows per statement as the parameter limit allows
+        size_t column_count = columns.size();
+        size_t max_rows = (size_t) sqlite3_limit(*db, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / column_count;
+        if (max_rows == 0) {
+            error_no = QUERY_BINDING_ERROR;
+            return 1;
+        }
+
+        sqlite3_stmt *stmt = prepare_insert(table, columns, max_rows);
+        if (!stmt) {
+            return 1;
+        }
+
+        SQLITE3_QUERY row;
+        std::vector<SQLITE3_VALUE> values;
+        values.reserve(max_rows * column_count);
+        while (true) {
+            row.reset_binding();
+            if (!row_source(row)) {
+                break;
+            }
+            if (row.values.size() != column_count) {
+                sqlite3_finalize(stmt);
+                error_no = QUERY_BINDING_ERROR;
+                return 1;
+            }
+
+            std::move(row.values.begin(), row.values.end(), std::back_inserter(values));
+            if (values.size() == max_rows * column_count) {
+                if (insert_rows(stmt, values)) {
+                    sqlite3_finalize(stmt);
+                    return 1;
+                }
+                values.clear();
+            }
+        }
+        sqlite3_finalize(stmt);
+
+        // remaining rows
+        if (!values.empty()) {
+            stmt = prepare_insert(table, columns, values.size() / column_count);
+            if (!stmt) {
+                return 1;
+            }
+            int rc = insert_rows(stmt, values);
+            sqlite3_finalize(stmt);
+            if (rc) {
+                return 1;
+            }
+        }
+
+        // recreate indexes, each is built in a single pass over the loaded table
+        for (auto &index : indexes) {
+            if (run_plain(index)) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Bind the values of query to the parameters of a prepared statement
+     * @param stmt prepared statement
+     * @param query query holding at least param_count bindings
+     * @param param_count number of parameters of stmt
+     * @param destructor SQLITE_STATIC if query outlives the execution, SQLITE_TRANSIENT otherwise
+     */
+    static void bind_values(sqlite3_stmt *stmt, const SQLITE3_QUERY &query, int param_count,
+                            sqlite3_destructor_type destructor) {
+        // binding modified directly, bind it as text
+        if (query.values.size() != query.binding.size()) {
+            for (int i = 0; i < param_count; ++i) {
+                const std::string &value = query.binding[i];
+                sqlite3_bind_text(stmt, i + 1, value.c_str(), (int) value.size(), destructor);
+            }
+            return;
+        }
+
+        for (int i = 0; i < param_count; ++i) {
+            bind_value(stmt, i + 1, query.values[i], destructor);
+        }
+    }
+
+    /**
+     * Bind a typed value to a parameter of a prepared statement
+     * @param stmt prepared statement
+     * @param index parameter index, starting from 1
+     * @param value
+     * @param destructor SQLITE_STATIC if value outlives the execution, SQLITE_TRANSIENT otherwise
+     */
+    static void bind_value(sqlite3_stmt *stmt, int index, const SQLITE3_VALUE &value,
+                           sqlite3_destructor_type destructor) {
+        switch (value.type) {
+            case SQLITE3_VALUE::INTEGER_VALUE:
+                sqlite3_bind_int64(stmt, index, value.integer);
+                break;
+            case SQLITE3_VALUE::FLOAT_VALUE:
+                sqlite3_bind_double(stmt, index, value.real);
+                break;
+            case SQLITE3_VALUE::TEXT_VALUE:
+                sqlite3_bind_text(stmt, index, value.bytes.c_str(), (int) value.bytes.size(), destructor);
+                break;
+            case SQLITE3_VALUE::BLOB_VALUE:
+                sqlite3_bind_blob(stmt, index, value.bytes.data(), (int) value.bytes.size(), destructor);
+                break;
+            case SQLITE3_VALUE::NULL_VALUE:
+                sqlite3_bind_null(stmt, index);
+                break;
+            case SQLITE3_VALUE::ZEROBLOB_VALUE:
+                sqlite3_bind_zeroblob64(stmt, index, (sqlite3_uint64) value.integer);
+                break;
+        }
+    }
+
+    /**
+     * Prepare the first statement of sql and wrap it in a cursor
+     * @param sql
+     * @param cached take the statement from the statement cache
+     * @return cursor
+     */
+    SQLITE3_CURSOR prepare_cursor(const std::string &sql, bool cached) {
+        sqlite3_stmt *stmt = cached ? stmt_cache->acquire(*db, sql) : nullptr;
+        if (stmt) {
+            return SQLITE3_CURSOR(db, stmt_cache, sql, stmt);
+        }
+
+        // not cacheable, prepare the first statement only
+        DB_LOCK lock(*db);
+        int rc = sqlite3_prepare_v2(*db, sql.c_str(), (int) sql.size() + 1, &stmt, nullptr);
+        if (rc != SQLITE_OK) { // check for error
+            sqlite3_finalize(stmt);
+            return SQLITE3_CURSOR(EXECUTION_ERROR, sqlite3_errmsg(*db));
+        }
+        return SQLITE3_CURSOR(db, nullptr, sql, stmt);
+    }
+
+    /**
+     * Run SQL text through the result cache
+     * @param sql
+     * @return 0 upon success, 1 upon failure
+     */
+    int execute_cached(const std::string &sql, EXECUTION &execution) {
+        // the lookup, the query and the store must not be interleaved with changes of other threads
+        DB_LOCK lock(*db);
+        std::string cache_key = SQLITE3_RESULT_CACHE::key_of(sql, (char) execution.mode);
+        if (load_cached_result(cache_key, execution)) {
+            return 0;
+        }
+
+        int rc = check_interrupt(run_sql(sql.c_str(), execution));
+        cache_result(cache_key, sql, rc, execution);
+        return rc;
+    }
+
+    /**
+     * Publish a cached result instead of running a query
+     * @param key cache key of the query
+     * @return true if the result was cached
+     */
+    bool load_cached_result(const std::string &key, EXECUTION &execution) {
+        SQLITE3_RESULT_CACHE::ENTRY entry;
+        if (!result_cache->lookup(key, data_version(), entry)) {
+            return false;
+        }
+
+        execution.rows = entry.rows;
+        execution.columns = entry.columns;
+        return true;
+    }
+
+    /**
+     * Cache the result of a query that ran, or drop the results it made stale
+     * @param key cache key of the query, empty to never cache it
+     * @param sql SQL text the query ran
+     * @param rc return code of the query
+     */
+    void cache_result(const std::string &key, const std::string &sql, int rc, const EXECUTION &execution) {
+        auto analysis = result_cache->analyze(*db, sql);
+        if (!analysis->cacheable) {
+            result_cache->invalidate(*analysis);
+        } else if (!rc && !key.empty()) {
+            SQLITE3_RESULT_CACHE::ENTRY entry;
+            entry.rows = execution.rows;
+            entry.columns = execution.columns;
+            result_cache->store(key, *analysis, entry);
+        }
+    }
+
+    /**
+     * Get PRAGMA data_version, it changes when another connection commits
+     * @return data version, -1 upon failure
+     */
+    int64_t data_version() {
+        static const std::string sql = "PRAGMA data_version;";
+
+        sqlite3_stmt *stmt = stmt_cache->acquire(*db, sql);
+        if (!stmt) {
+            return -1;
+        }
+
+        int64_t version = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+        stmt_cache->release(sql, stmt);
+        return version;
+    }
+
+    /**
+     * Deadline of the statements run by the calling thread, the deadline of an enclosing call,
+     * e.g. a bulk_insert whose row source runs queries, is restored when the call returns
+     */
+    struct DEADLINE {
+        explicit DEADLINE(std::chrono::milliseconds timeout)
+                : previous(until()), previously_expired(expired()) {
+            expired() = false;
+            auto own = timeout.count() > 0 ? std::chrono::steady_clock::now() + timeout
+                                           : std::chrono::steady_clock::time_point::max();
+            until() = own < previous ? own : previous; // a nested call cannot outlive the enclosing one
+        }
+
+        ~DEADLINE() {
+            until() = previous;
+            expired() = previously_expired || expired();
+        }
+
+        DEADLINE(const DEADLINE &) = delete;
+        DEADLINE &operator=(const DEADLINE &) = delete;
+
+        std::chrono::steady_clock::time_point previous;
+        bool previously_expired;
+
+        static std::chrono::steady_clock::time_point &until() {
+            static thread_local std::chrono::steady_clock::time_point deadline =
+                    std::chrono::steady_clock::time_point::max();
+            return deadline;
+        }
+
+        static bool &expired() {
+            static thread_local bool flag = false;
+            return flag;
+        }
+    };
+
+    /**
+     * sqlite3_progress_handler callback, interrupt the statement once the deadline of its thread passed
+     * @return 0 to continue, 1 to interrupt
+     */
+    static int progress_callback(void *) {
+        auto until = DEADLINE::until();
+        if (until == std::chrono::steady_clock::time_point::max() || std::chrono::steady_clock::now() < until) {
+            return 0;
+        }
+
+        DEADLINE::expired() = true;
+        return 1;
+    }
+
+    /**
+     * Turn the error of an interrupted call into TIMEOUT_ERROR or CANCELLED_ERROR
+     * @param rc return code of the call
+     * @return rc
+     */
+    int check_interrupt(int rc) {
+        if (!rc || error_no != EXECUTION_ERROR || (error_code & 0xff) != SQLITE_INTERRUPT) {
+            return rc;
+        }
+
+        if (DEADLINE::expired()) {
+            error_no = TIMEOUT_ERROR;
+            interrupts->timeouts += 1;
+
+            // let the clean up of the call run
+            DEADLINE::until() = std::chrono::steady_clock::time_point::max();
+        } else {
+            error_no = CANCELLED_ERROR;
+            interrupts->cancellations += 1;
+        }
+
+        // SQLite rolls back the whole transaction when some statements are interrupted
+        if (sqlite3_get_autocommit(*db)) {
+            start_transaction();
+        }
+        return rc;
+    }
+
+    /**
+     * Read all rows of a cursor into rows
+     * @param cursor
+     * @param rows
+     * @return 0 upon success, 1 upon failure
+     */
+    template<typename T>
+    int read_rows(SQLITE3_CURSOR cursor, std::vector<T> &rows) {
+        SQLITE3_ROW_MAPPER<T> mapper;
+        sqlite3_stmt *stmt = cursor.get_stmt();
+
+        // check columns once for the whole statement
+        if (stmt && mapper.check(stmt, err_msg_str)) {
+            error_no = EXECUTION_ERROR;
+            return 1;
+        }
+
+        while (cursor.next()) {
+            rows.emplace_back();
+            mapper.read(stmt, rows.back());
+        }
+
+        if (cursor.error_no) { // check for error
+            error_no = cursor.error_no;
+            error_code = cursor.error_code;
+            err_msg_str = cursor.err_msg_str;
+            return check_interrupt(1);
+        }
+        return 0;
+    }
+
+    /**
+     * Register a range table
+     * @param range returns the current begin and end of the rows
+     * @return 0 upon success, 1 upon failure
+     */
+    template<typename ITERATOR>
+    int register_range_table(const std::string &name, typename SQLITE3_RANGE_TABLE<ITERATOR>::RANGE range,
+                             const std::vector<std::string> &columns, const std::string &sorted_by) {
+        // idle statements may still use a table being replaced
+        stmt_cache->clear();
+        if (SQLITE3_RANGE_TABLE<ITERATOR>::create(*db, name, std::move(range), columns, sorted_by, err_msg_str)) {
+            error_no = EXECUTION_ERROR;
+            return 1;
+        }
+
+        result_cache->set_external_table(name);
+        return 0;
+    }
+
+    /**
+     * Check the result of registering a user defined function
+     * @param rc sqlite return code
+     * @param name name of function
+     * @param flags flags it was registered with, results of volatile functions are not cached
+     * @return 0 upon success, 1 upon failure
+     */
+    int check_function(int rc, const std::string &name, int flags) {
+        if (rc != SQLITE_OK) {
+            error_no = EXECUTION_ERROR;
+            err_msg_str = sqlite3_errmsg(*db);
+            return 1;
+        }
+
+        result_cache->set_deterministic(name, (flags & SQLITE_DETERMINISTIC) != 0);
+        return 0;
+    }
+
+    /**
+     * Copy the main database into target one step at a time, queries of other threads run between steps
+     *
+     * Each step holds the mutex of both connections, source first as sqlite3_backup_step takes them,
+     * none is held while sleeping. Steps finding a database locked are retried until the busy
+     * timeout is used up
+     * @param target connection to overwrite, not in a transaction
+     * @param pages_per_step pages copied per step
+     * @param sleep pause between steps
+     * @return 0 upon success, 1 upon failure
+     */
+    int run_backup(sqlite3 *target, int pages_per_step, std::chrono::milliseconds sleep) {
+        // check if database connection is open
+        if (!*db) {
+            error_no = UNINITIALIZED_ERROR;
+            return 1;
+        }
+
+        // steps fail while this connection has uncommitted changes, waiting would never end
+        if (sqlite3_txn_state(*db, "main") == SQLITE_TXN_WRITE) {
+            err_msg_str = "Uncommitted changes, commit before the backup";
+            error_no = EXECUTION_ERROR;
+            return 1;
+        }
+
+        sqlite3_backup *backup = sqlite3_backup_init(target, "main", *db, "main");
+        if (!backup) { // check for error
+            err_msg_str = std::string(sqlite3_errmsg(target));
+            error_no = EXECUTION_ERROR;
+            return 1;
+        }
+
+        // let queries through between steps, locked databases are retried
+        int rc;
+        auto locked_since = std::chrono::steady_clock::time_point::max();
+        while (true) {
+            {
+                DB_LOCK source_lock(*db);
+                DB_LOCK target_lock(target);
+                rc = sqlite3_backup_step(backup, pages_per_step);
+            }
+
+            if (rc == SQLITE_OK) {
+                locked_since = std::chrono::steady_clock::time_point::max();
+            } else if ((rc & 0xff) == SQLITE_BUSY || (rc & 0xff) == SQLITE_LOCKED) {
+                auto now = std::chrono::steady_clock::now();
+                locked_since = locked_since < now ? locked_since : now;
+                if (now - locked_since >= busy_handler->get_timeout()) {
+                    break; // gave up waiting for the lock
+                }
+            } else {
+                break; // done or failed
+            }
+            std::this_thread::sleep_for(sleep);
+        }
+
+        // a step still finding a database locked is not an error for sqlite3_backup_finish
+        int finished = sqlite3_backup_finish(backup);
+        if (rc != SQLITE_DONE || finished != SQLITE_OK) { // check for error
+            err_msg_str = std::string(finished != SQLITE_OK ? sqlite3_errmsg(target) : sqlite3_errstr(rc));
+            error_no = EXECUTION_ERROR;
+            return 1;
         }
+
         return 0;
     }
 
     /**
-     * Collect results and put into result vector
-     * @param ptr pointer to result vector
-     * @param argc number of column
-     * @param argv result char**
-     * @param col_name column name
-     * @return 0
+     * Start collecting the result of an execution, published executions clear the previous result
+     * @param execution
+     */
+    void begin_results(EXECUTION &execution) {
+        execution.rows = empty_rows();
+        execution.columns = empty_columns();
+        if (execution.publish) {
+            clear_results();
+        }
+    }
+
+    /**
+     * Store the result of an execution for get_result() and friends
+     * @param execution
+     */
+    void publish(const EXECUTION &execution) {
+        if (execution.publish && execution.rows) {
+            // readers of copy_result() must not build the rows of a published result
+            if (result_arena->build_rows) {
+                execution.rows->get_rows();
+            }
+
+            std::atomic_store(result.get(), execution.rows);
+            std::atomic_store(columnar_result.get(), execution.columns);
+        }
+    }
+
+    /**
+     * Replace the published results of the previous query by empty ones
+     *
+     * Results handed out before are not modified, the previous row result is kept for
+     * reuse if nobody else holds it
+     */
+    void clear_results() {
+        auto previous = std::atomic_exchange(result.get(), empty_rows());
+        std::atomic_store(columnar_result.get(), empty_columns());
+
+        // once unpublished nobody can take a new reference, so a single owner means it is ours
+        if (previous != empty_rows() && previous.use_count() == 1) {
+            std::atomic_store(&result_arena->spare, std::const_pointer_cast<SQLITE3_RESULT>(previous));
+        }
+    }
+
+    /**
+     * Get an empty row result, reusing the storage of a previous one if possible
+     * @return result to fill
+     */
+    std::shared_ptr<SQLITE3_RESULT> new_row_result() {
+        auto rows = std::atomic_exchange(&result_arena->spare, std::shared_ptr<SQLITE3_RESULT>());
+        if (!rows) {
+            return std::make_shared<SQLITE3_RESULT>();
+        }
+
+        rows->reset(result_arena->max_capacity);
+        return rows;
+    }
+
+    /**
+     * Get the shared empty row result
+     * @return empty result
+     */
+    static const std::shared_ptr<const SQLITE3_RESULT> &empty_rows() {
+        static const std::shared_ptr<const SQLITE3_RESULT> empty = std::make_shared<const SQLITE3_RESULT>();
+        return empty;
+    }
+
+    /**
+     * Get the shared empty columnar result
+     * @return empty result
+     */
+    static const std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> &empty_columns() {
+        static const std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> empty =
+                std::make_shared<const SQLITE3_COLUMNAR_RESULT>();
+        return empty;
+    }
+
+    /**
+     * Step a prepared statement to completion and collect its rows
+     * @param stmt prepared statement with all parameters bound
+     * @param rows result to fill
+     * @return SQLITE_OK upon success, sqlite error code upon failure
+     */
+    int step_statement(sqlite3_stmt *stmt, SQLITE3_RESULT &rows) {
+        int rc;
+        while ((rc = step(stmt)) == SQLITE_ROW) {
+            rows.append_row(stmt);
+        }
+
+        return rc == SQLITE_DONE ? SQLITE_OK : rc;
+    }
+
+    /**
+     * Check that every parameter of a statement is an anonymous ?, bindings are matched by position
+     * and cannot fill :name, @name, $name or ?NNN parameters
+     * @param stmt prepared statement
+     * @return true if all parameters are anonymous
+     */
+    static bool has_anonymous_parameters(sqlite3_stmt *stmt) {
+        int param_count = sqlite3_bind_parameter_count(stmt);
+        for (int i = 1; i <= param_count; ++i) {
+            if (sqlite3_bind_parameter_name(stmt, i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Close a connection, statements still in use keep it open until they are finalized
+     * @param handle connection
+     * @param cache statement cache of the connection
      */
-    static int exec_callback(void *ptr, int argc, char *argv[], char *col_name[]) {
-        auto *data = reinterpret_cast<Callback_Data *>(ptr);
+    static void close_connection(sqlite3 *handle, SQLITE3_STMT_CACHE &cache) {
+        cache.clear();
+
+        // a connection with unfinalized statements lingers as a zombie, its hooks must not outlive their objects
+        sqlite3_trace_v2(handle, 0, nullptr, nullptr);
+        SQLITE3_RESULT_CACHE::detach(handle);
+        sqlite3_busy_handler(handle, nullptr, nullptr);
+        sqlite3_close_v2(handle);
+    }
 
-        // record column name if needed
-        if (data->col->empty()) {
-            for (int i = 0; i < argc; ++i) {
-                data->col->push_back(std::string(col_name[i] ? col_name[i] : "NULL"));
+    /**
+     * Deleter of db, closes the connection and keeps what it refers to alive until then
+     */
+    struct CONNECTION_CLOSER {
+        std::shared_ptr<SQLITE3_STMT_CACHE> stmt_cache;
+        std::shared_ptr<SQLITE3_PROFILER> profiler;
+        std::shared_ptr<SQLITE3_RESULT_CACHE> result_cache;
+        std::shared_ptr<SQLITE3_BUSY_HANDLER> busy_handler;
+
+        void operator()(sqlite3 **handle) const {
+            if (*handle) {
+                close_connection(*handle, *stmt_cache);
             }
+            delete handle;
+        }
+    };
+
+    /**
+     * Open db_name into *db and apply options, *db is nullptr upon failure
+     * @param db_name name of database to open
+     * @param options settings applied to the connection
+     * @return 0 upon success, 1 upon failure
+     */
+    int open_connection(const std::string &db_name, const SQLITE3_OPTIONS &options) {
+        // statements of copies of this object may run from several threads
+        int flags = options.open_flags;
+        if (!(flags & SQLITE_OPEN_NOMUTEX)) {
+            flags |= SQLITE_OPEN_FULLMUTEX;
         }
 
-        // get result
-        SQLITE_ROW_VECTOR row;
-        for (int i = 0; i < argc; i++) {
-            row.push_back(std::string(argv[i] ? argv[i] : "NULL"));
+        int rc = sqlite3_open_v2(db_name.c_str(), db.get(), flags, nullptr);
+        if (rc == SQLITE_OK) {
+            rc = options.apply(*db);
+        }
+        if (rc != SQLITE_OK) { // check for error
+            err_msg_str = *db ? sqlite3_errmsg(*db) : sqlite3_errstr(rc);
+            sqlite3_close(*db);
+            *db = nullptr;
+            return 1;
         }
 
-        // push SQLITE_ROW_VECTOR to result vector
-        data->rows->push_back(row);
+        sqlite3_progress_handler(*db, PROGRESS_INTERVAL, &progress_callback, nullptr);
+        return 0;
+    }
+
+    /**
+     * Begin a new transaction
+     * @return 0 upon success, 1 upon failure
+     */
+    int start_transaction() {
+        char *err_msg = nullptr;
+        int rc = sqlite3_exec(*db, "BEGIN;", nullptr, nullptr, &err_msg);
+        if (rc != SQLITE_OK) { // check for error
+            // copy error message and free memory
+            err_msg_str = std::string(err_msg ? err_msg : sqlite3_errmsg(*db));
+            sqlite3_free(err_msg);
+            error_no = EXECUTION_ERROR;
 
+            return 1;
+        }
         return 0;
     }
 
@@ -527,17 +2194,53 @@ public:
     char error_no{}; // class wide error code
 
 private:
+    friend class SQLITE3_ASYNC;
+    friend class SQLITE3_MAINTENANCE;
+
     // sqlite objects
     std::shared_ptr<sqlite3 *> db;
-    std::shared_ptr<char *> err_msg;
     std::string err_msg_str;
+    int error_code{}; // sqlite return code of the last failed call
 
     // query results
-    std::shared_ptr<SQLITE_ROW_VECTOR> column_name; // vector storing result column name
-    std::shared_ptr<std::vector<SQLITE_ROW_VECTOR>> result; // result stored in matrix format
-
-    // To prevent concurrent access
-    std::shared_ptr<std::mutex> exec_lock;
+    std::shared_ptr<std::shared_ptr<const SQLITE3_RESULT>> result; // result stored in matrix format
+    std::shared_ptr<std::shared_ptr<const SQLITE3_COLUMNAR_RESULT>> columnar_result; // result stored by column
+    SQLITE3_RESULT_MODE result_mode{ROW_RESULT};
+
+    // prepared statements reused by execute(SQLITE3_QUERY &)
+    std::shared_ptr<SQLITE3_STMT_CACHE> stmt_cache;
+
+    // statement statistics, collected once enable_profiling is called
+    std::shared_ptr<SQLITE3_PROFILER> profiler;
+
+    // time limit of each call, interrupted calls are counted
+    struct INTERRUPT_COUNTERS {
+        std::atomic<uint64_t> timeouts{};
+        std::atomic<uint64_t> cancellations{};
+    };
+    std::shared_ptr<INTERRUPT_COUNTERS> interrupts;
+    std::chrono::milliseconds query_timeout{0};
+
+    // results of read-only queries, enabled by set_result_cache_budget
+    std::shared_ptr<SQLITE3_RESULT_CACHE> result_cache;
+
+    // storage of a released row result, reused by the next query
+    struct RESULT_ARENA {
+        std::shared_ptr<SQLITE3_RESULT> spare;
+        std::atomic<size_t> max_capacity{SIZE_MAX};
+        std::atomic<bool> build_rows{false}; // set once copy_result() is used
+    };
+    std::shared_ptr<RESULT_ARENA> result_arena;
+
+    // backoff while the database is locked by another connection, COMMIT retries upon SQLITE_BUSY
+    std::shared_ptr<SQLITE3_BUSY_HANDLER> busy_handler;
+    int commit_retries{3};
+
+    // result returned by the deprecated get_result(), kept alive and out of the arena per object
+    mutable std::shared_ptr<const SQLITE3_RESULT> held_result;
+
+    // number of virtual machine instructions between deadline checks
+    static const int PROGRESS_INTERVAL = 1000;
 };
 
 
@@ -0,0 +1,333 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_ARROW_READER_HPP
+#define SQLITEPLUS_SQLITE3_ARROW_READER_HPP
+
+#include <sqlite3.h>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SQLITE3_COLUMNAR_RESULT.hpp"
+#include "SQLITE3_CURSOR.hpp"
+#include "SQLITE3_ERROR.hpp"
+
+// Arrow C Data Interface, https://arrow.apache.org/docs/format/CDataInterface.html
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    // Array type description
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema *);
+    // Opaque producer-specific data
+    void *private_data;
+};
+
+struct ArrowArray {
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray *);
+    // Opaque producer-specific data
+    void *private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+/**
+ * Reads the rows of a cursor in batches of Arrow arrays
+ *
+ * Every batch is a struct array with one child per column, its buffers are written by
+ * sqlite3_step through SQLITE3_COLUMNAR_RESULT and handed over without a copy. Columns map to
+ * int64 ("l"), float64 ("g"), large utf8 ("U"), large binary ("Z") or null ("n") arrays. SQLite
+ * types values, not columns: a column takes the widest storage class of the values in its batch,
+ * so the type of a column can differ between batches, check the schema of every batch.
+ * @code
+ * SQLITE3_ARROW_READER reader(db.query("SELECT id, price FROM orders;"), 65536);
+ * ArrowArray batch;
+ * ArrowSchema schema;
+ * while (reader.next_batch(&batch, &schema)) {
+ *     consume(&batch, &schema); // calls batch.release and schema.release when done
+ * }
+ * @endcode
+ */
+class SQLITE3_ARROW_READER {
+public:
+    /**
+     * Read the rows of a cursor
+     * @param cursor cursor of the query, the reader takes it over
+     * @param batch_size maximum number of rows per batch
+     */
+    explicit SQLITE3_ARROW_READER(SQLITE3_CURSOR cursor, size_t batch_size = 65536) : cursor(std::move(cursor)) {
+        this->batch_size = batch_size ? batch_size : 1;
+        this->error_no = this->cursor.error_no;
+        this->err_msg_str = this->cursor.err_msg_str;
+    }
+
+    /**
+     * Read the next batch, array and schema are owned by the caller afterwards and released
+     * through their release callbacks, in any order
+     * @param array set to the batch
+     * @param schema set to the schema of the batch
+     * @return true if a batch was read, false when done or upon failure
+     */
+    bool next_batch(ArrowArray *array, ArrowSchema *schema) {
+        if (!cursor.is_open()) {
+            return false;
+        }
+
+        auto batch = std::make_shared<SQLITE3_COLUMNAR_RESULT>();
+        batch->reset(cursor.get_stmt());
+        while (batch->row_count() < batch_size && cursor.next()) {
+            batch->append_row(cursor.get_stmt());
+        }
+        if (cursor.error_no != NO_ERROR) {
+            error_no = cursor.error_no;
+            err_msg_str = cursor.err_msg_str;
+            return false;
+        }
+        if (batch->row_count() == 0) {
+            return false;
+        }
+
+        export_result(batch, array, schema);
+        return true;
+    }
+
+    /**
+     * Get the maximum number of rows per batch
+     * @return batch size
+     */
+    size_t get_batch_size() const {
+        return batch_size;
+    }
+
+    /**
+     * Export a columnar result as one Arrow batch, the buffers are shared with the result
+     * @param result result to export, kept alive until the array is released
+     * @param array set to the batch
+     * @param schema set to the schema of the batch
+     * @return 0 upon success, 1 if result is empty
+     */
+    static int export_result(const std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> &result, ArrowArray *array,
+                             ArrowSchema *schema) {
+        if (!result) {
+            return 1;
+        }
+
+        // schema
+        auto *schema_data = new SCHEMA_DATA();
+        schema_data->format = "+s";
+        schema_data->children.resize(result->column_count());
+        for (size_t col = 0; col < result->column_count(); ++col) {
+            auto *child_data = new SCHEMA_DATA();
+            child_data->format = format_of(result->column_type(col));
+            child_data->name = result->column_name(col);
+            init_schema(&schema_data->children[col], child_data, ARROW_FLAG_NULLABLE);
+            schema_data->child_pointers.push_back(&schema_data->children[col]);
+        }
+        init_schema(schema, schema_data, 0);
+
+        // arrays
+        auto *array_data = new ARRAY_DATA();
+        array_data->result = result;
+        array_data->buffers.push_back(nullptr); // no NULL rows
+        array_data->children.resize(result->column_count());
+        for (size_t col = 0; col < result->column_count(); ++col) {
+            init_column(&array_data->children[col], result, col);
+            array_data->child_pointers.push_back(&array_data->children[col]);
+        }
+        init_array(array, array_data, (int64_t) result->row_count(), 0);
+        return 0;
+    }
+
+    /**
+     * Read the reader error_no and print parsed error to std::cerr
+     */
+    void perror() {
+        switch (error_no) {
+            case NO_ERROR:
+                break;
+            case QUERY_BINDING_ERROR:
+                std::cerr << "Query Binding Failed\n";
+                break;
+            case UNINITIALIZED_ERROR:
+                std::cerr << "No database connected\n";
+                break;
+            default:
+                std::cerr << err_msg_str << std::endl;
+                break;
+        }
+
+        error_no = NO_ERROR;
+    }
+
+public:
+    char error_no{}; // reader error code
+
+private:
+    /**
+     * Owned by an ArrowSchema, children are released with their parent unless moved out
+     */
+    struct SCHEMA_DATA {
+        std::string format;
+        std::string name;
+        std::vector<ArrowSchema> children;
+        std::vector<ArrowSchema *> child_pointers;
+    };
+
+    /**
+     * Owned by an ArrowArray, every array holds a reference to the result its buffers point into
+     */
+    struct ARRAY_DATA {
+        std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> result;
+        std::vector<const void *> buffers;
+        std::vector<ArrowArray> children;
+        std::vector<ArrowArray *> child_pointers;
+    };
+
+    static const char *format_of(SQLITE3_COLUMNAR_RESULT::TYPE type) {
+        switch (type) {
+            case SQLITE3_COLUMNAR_RESULT::INTEGER_COLUMN:
+                return "l";
+            case SQLITE3_COLUMNAR_RESULT::FLOAT_COLUMN:
+                return "g";
+            case SQLITE3_COLUMNAR_RESULT::TEXT_COLUMN:
+                return "U";
+            case SQLITE3_COLUMNAR_RESULT::BLOB_COLUMN:
+                return "Z";
+            default:
+                return "n";
+        }
+    }
+
+    static void init_schema(ArrowSchema *schema, SCHEMA_DATA *data, int64_t flags) {
+        memset(schema, 0, sizeof(ArrowSchema));
+        schema->format = data->format.c_str();
+        schema->name = data->name.c_str();
+        schema->flags = flags;
+        schema->n_children = (int64_t) data->child_pointers.size();
+        schema->children = data->child_pointers.empty() ? nullptr : data->child_pointers.data();
+        schema->release = &release_schema;
+        schema->private_data = data;
+    }
+
+    static void init_array(ArrowArray *array, ARRAY_DATA *data, int64_t length, int64_t null_count) {
+        memset(array, 0, sizeof(ArrowArray));
+        array->length = length;
+        array->null_count = null_count;
+        array->n_buffers = (int64_t) data->buffers.size();
+        array->buffers = data->buffers.empty() ? nullptr : data->buffers.data();
+        array->n_children = (int64_t) data->child_pointers.size();
+        array->children = data->child_pointers.empty() ? nullptr : data->child_pointers.data();
+        array->release = &release_array;
+        array->private_data = data;
+    }
+
+    /**
+     * Point the buffers of a child array at the buffers of a column
+     */
+    static void init_column(ArrowArray *array, const std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> &result,
+                            size_t col) {
+        const SQLITE3_COLUMNAR_RESULT::COLUMN &column = result->column(col);
+        auto rows = (int64_t) result->row_count();
+
+        auto *data = new ARRAY_DATA();
+        data->result = result;
+        if (column.type == SQLITE3_COLUMNAR_RESULT::NULL_COLUMN) { // null arrays have no buffers
+            init_array(array, data, rows, rows);
+            return;
+        }
+
+        int64_t null_count = 0;
+        for (int64_t row = 0; row < rows; ++row) {
+            null_count += !(column.validity[row >> 3] & (1u << (row & 7)));
+        }
+        data->buffers.push_back(null_count ? column.validity.data() : nullptr);
+        switch (column.type) {
+            case SQLITE3_COLUMNAR_RESULT::INTEGER_COLUMN:
+                data->buffers.push_back(column.integers.data());
+                break;
+            case SQLITE3_COLUMNAR_RESULT::FLOAT_COLUMN:
+                data->buffers.push_back(column.reals.data());
+                break;
+            default:
+                data->buffers.push_back(column.offsets.data());
+                data->buffers.push_back(column.arena.data());
+                break;
+        }
+        init_array(array, data, rows, null_count);
+    }
+
+    static void release_schema(ArrowSchema *schema) {
+        auto *data = reinterpret_cast<SCHEMA_DATA *>(schema->private_data);
+        for (auto &child : data->children) {
+            if (child.release) { // not moved out by the consumer
+                child.release(&child);
+            }
+        }
+        delete data;
+        schema->release = nullptr;
+    }
+
+    static void release_array(ArrowArray *array) {
+        auto *data = reinterpret_cast<ARRAY_DATA *>(array->private_data);
+        for (auto &child : data->children) {
+            if (child.release) { // not moved out by the consumer
+                child.release(&child);
+            }
+        }
+        delete data;
+        array->release = nullptr;
+    }
+
+    SQLITE3_CURSOR cursor;
+    size_t batch_size;
+    std::string err_msg_str;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_ARROW_READER_HPP
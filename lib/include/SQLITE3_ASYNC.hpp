@@ -0,0 +1,272 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_ASYNC_HPP
+#define SQLITEPLUS_SQLITE3_ASYNC_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "SQLITE3.hpp"
+
+/**
+ * Outcome of a statement run by SQLITE3_ASYNC
+ */
+struct SQLITE3_ASYNC_RESULT {
+    int rc{}; // 0 upon success, 1 upon failure
+    char error_no{}; // error code upon failure
+    std::string err_msg_str; // error message upon failure
+    std::shared_ptr<const SQLITE3_RESULT> rows; // result in ROW_RESULT mode
+    std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> columns; // result in COLUMNAR_RESULT mode
+};
+
+/**
+ * Asynchronous front-end running statements on a dedicated connection and worker thread
+ *
+ * Statements are queued from any thread and run in order. The worker takes every queued
+ * statement at once and runs them back to back, so a burst of statements costs a single
+ * thread handoff. Use one instance per connection to run statements in parallel.
+ */
+class SQLITE3_ASYNC {
+public:
+    /**
+     * Completion callback, runs on the worker thread and must not throw
+     */
+    typedef std::function<void(SQLITE3_ASYNC_RESULT)> COMPLETION;
+
+    /**
+     * Constructor, open db_name and start the worker thread
+     * @param db_name name of database to open
+     * @param mode how results are stored
+     * @throw std::runtime_error if the database cannot be opened
+     */
+    explicit SQLITE3_ASYNC(const std::string &db_name, SQLITE3_RESULT_MODE mode = ROW_RESULT) : db(db_name) {
+        db.set_result_mode(mode);
+
+        worker = std::thread(&SQLITE3_ASYNC::run, this);
+    }
+
+    SQLITE3_ASYNC(const SQLITE3_ASYNC &rhs) = delete;
+
+    SQLITE3_ASYNC &operator=(const SQLITE3_ASYNC &rhs) = delete;
+
+    /**
+     * Destructor, run all queued statements and stop the worker thread
+     *
+     * Statements not followed by commit_async() are rolled back when the connection is closed
+     */
+    ~SQLITE3_ASYNC() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        queued.notify_one();
+        worker.join();
+    }
+
+    /**
+     * Queue a query
+     * @param query
+     * @return future set once the query ran
+     */
+    std::future<SQLITE3_ASYNC_RESULT> execute_async(const SQLITE3_QUERY &query) {
+        JOB job(STATEMENT);
+        job.query = query;
+        return enqueue_future(std::move(job));
+    }
+
+    /**
+     * Queue one or more SQL statements
+     * @param query
+     * @return future set once the statements ran
+     */
+    std::future<SQLITE3_ASYNC_RESULT> execute_async(const std::string &query) {
+        JOB job(PLAIN);
+        job.sql = query;
+        return enqueue_future(std::move(job));
+    }
+
+    /**
+     * Queue a query
+     * @param query
+     * @param callback called on the worker thread once the query ran
+     */
+    void execute_async(const SQLITE3_QUERY &query, COMPLETION callback) {
+        JOB job(STATEMENT);
+        job.query = query;
+        job.callback = std::move(callback);
+        enqueue(std::move(job));
+    }
+
+    /**
+     * Queue one or more SQL statements
+     * @param query
+     * @param callback called on the worker thread once the statements ran
+     */
+    void execute_async(const std::string &query, COMPLETION callback) {
+        JOB job(PLAIN);
+        job.sql = query;
+        job.callback = std::move(callback);
+        enqueue(std::move(job));
+    }
+
+    /**
+     * Queue a commit of every statement queued before it
+     * @return future set once committed
+     */
+    std::future<SQLITE3_ASYNC_RESULT> commit_async() {
+        return enqueue_future(JOB(COMMIT));
+    }
+
+    /**
+     * Get the number of statements waiting for the worker
+     * @return number of queued statements
+     */
+    size_t queue_size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return queue.size();
+    }
+
+private:
+    /**
+     * \private
+     */
+    enum JOB_TYPE {STATEMENT, PLAIN, COMMIT};
+
+    /**
+     * \private
+     */
+    struct JOB {
+        explicit JOB(JOB_TYPE type) {
+            this->type = type;
+        }
+
+        JOB_TYPE type;
+        SQLITE3_QUERY query;
+        std::string sql;
+        COMPLETION callback;
+        std::promise<SQLITE3_ASYNC_RESULT> done;
+    };
+
+    /**
+     * Put job into the queue and return its future
+     */
+    std::future<SQLITE3_ASYNC_RESULT> enqueue_future(JOB &&job) {
+        std::future<SQLITE3_ASYNC_RESULT> ret = job.done.get_future();
+        enqueue(std::move(job));
+        return ret;
+    }
+
+    /**
+     * Put job into the queue
+     */
+    void enqueue(JOB &&job) {
+        bool was_empty;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            was_empty = queue.empty();
+            queue.push_back(std::move(job));
+        }
+
+        // the worker drains the whole queue before waiting again
+        if (was_empty) {
+            queued.notify_one();
+        }
+    }
+
+    /**
+     * Run one job
+     */
+    SQLITE3_ASYNC_RESULT run_job(JOB &job) {
+        SQLITE3_ASYNC_RESULT result;
+        switch (job.type) {
+            case STATEMENT:
+                result.rc = db.execute(job.query);
+                break;
+            case PLAIN:
+                result.rc = db.execute(job.sql);
+                break;
+            case COMMIT:
+                result.rc = db.commit();
+                break;
+        }
+
+        result.error_no = db.error_no;
+        if (result.rc) {
+            result.err_msg_str = db.err_msg_str;
+        }
+        db.error_no = NO_ERROR;
+        if (job.type != COMMIT) {
+            result.rows = db.get_row_result();
+            result.columns = db.get_columnar_result();
+        }
+        return result;
+    }
+
+    /**
+     * Worker thread
+     */
+    void run() {
+        std::deque<JOB> taken;
+
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            queued.wait(guard, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) { // stopping and nothing left
+                return;
+            }
+
+            // take everything queued, run it without holding the lock
+            taken.swap(queue);
+            guard.unlock();
+
+            for (auto &job : taken) {
+                SQLITE3_ASYNC_RESULT result = run_job(job);
+                if (job.callback) {
+                    job.callback(std::move(result));
+                } else {
+                    job.done.set_value(std::move(result));
+                }
+            }
+            taken.clear();
+
+            guard.lock();
+        }
+    }
+
+    SQLITE3 db;
+    std::thread worker;
+
+    std::deque<JOB> queue;
+    bool stopping{};
+
+    mutable std::mutex lock;
+    std::condition_variable queued;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_ASYNC_HPP
@@ -0,0 +1,311 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_BLOB_HPP
+#define SQLITEPLUS_SQLITE3_BLOB_HPP
+
+#include <sqlite3.h>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SQLITE3_ERROR.hpp"
+#include "SQLITE3_RESULT_CACHE.hpp"
+
+/**
+ * Incremental reader and writer of one BLOB or TEXT cell
+ *
+ * Byte ranges are read and written in place with sqlite3_blob_read and sqlite3_blob_write,
+ * the cell is never loaded whole. Writes cannot change the size of the cell, insert a
+ * zeroblob of the final size first. The handle is invalidated when its row is changed
+ * by anything else, following reads and writes then fail.
+ */
+class SQLITE3_BLOB {
+public:
+    /**
+     * Chunk callback
+     * @param data bytes of the chunk
+     * @param length number of bytes
+     * @param offset position of the chunk in the cell
+     * @return true to continue, false to stop reading
+     */
+    typedef std::function<bool(const char *data, size_t length, size_t offset)> CHUNK_CALLBACK;
+
+    /**
+     * \private
+     * Wrap an open blob handle
+     * @param db database the handle belongs to
+     * @param blob open handle
+     * @param table table of the cell, to notify cache of writes
+     * @param cache result cache to notify of writes, nullptr if none
+     */
+    SQLITE3_BLOB(std::shared_ptr<sqlite3 *> db, sqlite3_blob *blob, std::string table,
+                 std::shared_ptr<SQLITE3_RESULT_CACHE> cache) {
+        this->db = std::move(db);
+        this->blob = blob;
+        this->table = std::move(table);
+        this->cache = std::move(cache);
+    }
+
+    /**
+     * \private
+     * Create a handle that failed to open
+     * @param error_no error code
+     * @param err_msg_str error message
+     */
+    SQLITE3_BLOB(char error_no, std::string err_msg_str) {
+        this->error_no = error_no;
+        this->err_msg_str = std::move(err_msg_str);
+    }
+
+    SQLITE3_BLOB(const SQLITE3_BLOB &rhs) = delete;
+
+    SQLITE3_BLOB &operator=(const SQLITE3_BLOB &rhs) = delete;
+
+    /**
+     * move construction
+     */
+    SQLITE3_BLOB(SQLITE3_BLOB &&rhs) noexcept {
+        *this = std::move(rhs);
+    }
+
+    /**
+     * move assign
+     */
+    SQLITE3_BLOB &operator=(SQLITE3_BLOB &&rhs) noexcept {
+        if (this == &rhs) { // self assignment guard
+            return *this;
+        }
+        close();
+
+        db = std::move(rhs.db);
+        blob = rhs.blob;
+        rhs.blob = nullptr;
+        table = std::move(rhs.table);
+        cache = std::move(rhs.cache);
+        error_no = rhs.error_no;
+        err_msg_str = std::move(rhs.err_msg_str);
+
+        return *this;
+    }
+
+    /**
+     * Destructor
+     */
+    ~SQLITE3_BLOB() {
+        close();
+    }
+
+    /**
+     * Check if the handle can be read
+     * @return true until closed, false if it failed to open
+     */
+    bool is_open() const {
+        return blob != nullptr;
+    }
+
+    /**
+     * Get the size of the cell
+     * @return size in bytes, 0 if not open
+     */
+    size_t size() const {
+        return blob ? (size_t) sqlite3_blob_bytes(blob) : 0;
+    }
+
+    /**
+     * Read a byte range
+     * @param buffer destination, at least length bytes
+     * @param length number of bytes to read
+     * @param offset position of the first byte in the cell
+     * @return 0 upon success, 1 upon failure, including a range past the end of the cell or beyond INT_MAX
+     */
+    int read(void *buffer, size_t length, size_t offset) {
+        if (check_open() || check_range(length, offset)) {
+            return 1;
+        }
+        return check(sqlite3_blob_read(blob, buffer, (int) length, (int) offset));
+    }
+
+    /**
+     * Read a byte range in chunks, one buffer is reused for every chunk
+     * @param chunk_size maximum number of bytes per chunk, greater than 0
+     * @param callback called once per chunk, in order
+     * @param offset position of the first byte in the cell
+     * @param length number of bytes to read, SIZE_MAX reads to the end of the cell
+     * @return 0 upon success, 1 upon failure
+     */
+    int read_chunks(size_t chunk_size, const CHUNK_CALLBACK &callback, size_t offset = 0,
+                    size_t length = SIZE_MAX) {
+        if (check_open()) {
+            return 1;
+        }
+        if (chunk_size == 0) {
+            err_msg_str = "Chunk size must be greater than 0";
+            error_no = EXECUTION_ERROR;
+            return 1;
+        }
+
+        size_t end = size();
+        if (offset > end) {
+            return check(SQLITE_ERROR);
+        }
+        if (length < end - offset) {
+            end = offset + length;
+        }
+
+        // positions stay below the size of the cell, which fits in an int
+        std::vector<char> buffer(chunk_size < end - offset ? chunk_size : end - offset);
+        for (size_t position = offset; position < end; position += buffer.size()) {
+            size_t chunk = end - position < buffer.size() ? end - position : buffer.size();
+            if (check(sqlite3_blob_read(blob, buffer.data(), (int) chunk, (int) position))) {
+                return 1;
+            }
+            if (!callback(buffer.data(), chunk, position)) {
+                break;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Overwrite a byte range, the handle must have been opened writable
+     * @param data bytes to write
+     * @param length number of bytes
+     * @param offset position of the first byte in the cell
+     * @return 0 upon success, 1 upon failure, including a range past the end of the cell or beyond INT_MAX
+     */
+    int write(const void *data, size_t length, size_t offset) {
+        if (check_open() || check_range(length, offset)) {
+            return 1;
+        }
+        if (check(sqlite3_blob_write(blob, data, (int) length, (int) offset))) {
+            return 1;
+        }
+
+        // blob writes do not run the update hook
+        if (cache && cache->is_enabled()) {
+            cache->record_write(table);
+        }
+        return 0;
+    }
+
+    /**
+     * Move the handle to the same column of another row, faster than opening a new handle
+     * @param rowid rowid of the row
+     * @return 0 upon success, 1 upon failure, the handle is unusable after a failure
+     */
+    int reopen(int64_t rowid) {
+        if (check_open()) {
+            return 1;
+        }
+        return check(sqlite3_blob_reopen(blob, (sqlite3_int64) rowid));
+    }
+
+    /**
+     * Close the handle
+     */
+    void close() {
+        if (!blob) {
+            return;
+        }
+
+        // a closed connection is only released once its blob handles are closed
+        sqlite3_blob_close(blob);
+        blob = nullptr;
+    }
+
+    /**
+     * Read the blob error_no and print parsed error to std::cerr
+     */
+    void perror() {
+        switch (error_no) {
+            case NO_ERROR:
+                break;
+            case UNINITIALIZED_ERROR:
+                std::cerr << "No database connected\n";
+                break;
+            default:
+                std::cerr << err_msg_str << std::endl;
+                break;
+        }
+
+        error_no = NO_ERROR;
+    }
+
+public:
+    char error_no{}; // blob error code
+
+private:
+    /**
+     * Fail if the handle is not open
+     * @return 0 if open, 1 otherwise
+     */
+    int check_open() {
+        if (blob) {
+            return 0;
+        }
+        err_msg_str = "Blob is not open";
+        error_no = EXECUTION_ERROR;
+        return 1;
+    }
+
+    /**
+     * Fail if a byte range cannot be passed to sqlite, which takes int lengths and offsets
+     * @param length number of bytes
+     * @param offset position of the first byte
+     * @return 0 if both fit in an int, 1 otherwise
+     */
+    int check_range(size_t length, size_t offset) {
+        if (length <= INT_MAX && offset <= INT_MAX) {
+            return 0;
+        }
+        err_msg_str = "Blob length and offset must not exceed INT_MAX";
+        error_no = EXECUTION_ERROR;
+        return 1;
+    }
+
+    /**
+     * Record the error of a failed call
+     * @param rc sqlite return code
+     * @return 0 if rc is SQLITE_OK, 1 otherwise
+     */
+    int check(int rc) {
+        if (rc == SQLITE_OK) {
+            return 0;
+        }
+        err_msg_str = sqlite3_errstr(rc);
+        error_no = EXECUTION_ERROR;
+        return 1;
+    }
+
+    std::shared_ptr<sqlite3 *> db;
+    sqlite3_blob *blob{};
+    std::string table;
+    std::shared_ptr<SQLITE3_RESULT_CACHE> cache;
+    std::string err_msg_str;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_BLOB_HPP
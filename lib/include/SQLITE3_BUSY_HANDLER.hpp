@@ -0,0 +1,191 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_BUSY_HANDLER_HPP
+#define SQLITEPLUS_SQLITE3_BUSY_HANDLER_HPP
+
+#include <sqlite3.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <thread>
+
+/**
+ * Contention statistics of a connection
+ */
+struct SQLITE3_BUSY_STATS {
+    uint64_t contentions{}; // operations that found the database locked by another connection
+    uint64_t waits{}; // sleeps before trying again
+    uint64_t timeouts{}; // operations that gave up and failed with SQLITE_BUSY
+    uint64_t commit_retries{}; // COMMITs run again after SQLITE_BUSY
+    std::chrono::microseconds wait_time{0}; // total time spent sleeping
+};
+
+/**
+ * sqlite3_busy_handler sleeping with exponential backoff and jitter while the database is locked
+ *
+ * The n-th sleep of an operation lasts between half and all of min(initial_delay * 2^n, max_delay),
+ * picked at random so that connections waiting for the same lock do not retry in lockstep.
+ * The operation fails with SQLITE_BUSY once it waited for timeout in total.
+ */
+class SQLITE3_BUSY_HANDLER {
+public:
+    /**
+     * Set the backoff
+     * @param initial_delay first sleep
+     * @param max_delay longest sleep
+     * @param timeout total sleep time after which an operation fails
+     */
+    void configure(std::chrono::microseconds initial_delay, std::chrono::microseconds max_delay,
+                   std::chrono::microseconds timeout) {
+        initial_us = initial_delay.count() > 0 ? initial_delay.count() : 1;
+        max_us = max_delay.count() > initial_us ? max_delay.count() : initial_us.load();
+        timeout_us = timeout.count() > 0 ? timeout.count() : 0;
+    }
+
+    /**
+     * Install the handler on a connection, or restore sqlite3_busy_timeout
+     * @param db connection
+     * @param enable true to install the handler
+     * @param busy_timeout milliseconds passed to sqlite3_busy_timeout when the handler is removed
+     * @return SQLITE_OK upon success, sqlite error code upon failure
+     */
+    int attach(sqlite3 *db, bool enable, int busy_timeout = 0) {
+        enabled = enable;
+        return enable ? sqlite3_busy_handler(db, &SQLITE3_BUSY_HANDLER::callback, this)
+                      : sqlite3_busy_timeout(db, busy_timeout);
+    }
+
+    /**
+     * Check if the handler is installed
+     * @return true if installed
+     */
+    bool is_enabled() const {
+        return enabled;
+    }
+
+    /**
+     * Get the sleep before the next attempt
+     * @param attempt number of attempts that failed already
+     * @return sleep duration
+     */
+    std::chrono::microseconds backoff(int attempt) const {
+        int64_t delay = initial_us;
+        for (int i = 0; i < attempt && delay < max_us; ++i) {
+            delay *= 2;
+        }
+        delay = delay < max_us ? delay : max_us.load();
+
+        static thread_local std::minstd_rand generator(std::random_device{}());
+        std::uniform_int_distribution<int64_t> jitter(delay / 2, delay);
+        return std::chrono::microseconds(jitter(generator));
+    }
+
+    /**
+     * Get the total sleep time after which an operation fails
+     * @return timeout
+     */
+    std::chrono::microseconds get_timeout() const {
+        return std::chrono::microseconds(timeout_us.load());
+    }
+
+    /**
+     * Sleep before running a COMMIT again and count it
+     * @param attempt number of attempts that failed already
+     * @param remaining time left of the timeout, the sleep is not longer
+     */
+    void wait_for_commit(int attempt, std::chrono::microseconds remaining) {
+        commit_retries += 1;
+        if (attempt == 0) {
+            contentions += 1;
+        }
+        auto delay = backoff(attempt);
+        sleep(delay < remaining ? delay : remaining);
+    }
+
+    /**
+     * Get the statistics collected so far
+     * @return statistics
+     */
+    SQLITE3_BUSY_STATS get_stats() const {
+        SQLITE3_BUSY_STATS stats;
+        stats.contentions = contentions;
+        stats.waits = waits;
+        stats.timeouts = timeouts;
+        stats.commit_retries = commit_retries;
+        stats.wait_time = std::chrono::microseconds(wait_us.load());
+        return stats;
+    }
+
+private:
+    /**
+     * sqlite3_busy_handler callback, runs with the database mutex held
+     * @param handler
+     * @param count number of times the handler was called for this lock
+     * @return 1 to try again, 0 to fail with SQLITE_BUSY
+     */
+    static int callback(void *handler, int count) {
+        auto *self = reinterpret_cast<SQLITE3_BUSY_HANDLER *>(handler);
+        if (count == 0) {
+            self->contentions += 1;
+            self->waited_us = 0;
+        }
+
+        int64_t remaining = self->timeout_us - self->waited_us;
+        if (remaining <= 0) {
+            self->timeouts += 1;
+            return 0;
+        }
+
+        auto delay = self->backoff(count);
+        if (delay.count() > remaining) {
+            delay = std::chrono::microseconds(remaining);
+        }
+        self->waited_us += delay.count();
+        self->sleep(delay);
+        return 1;
+    }
+
+    void sleep(std::chrono::microseconds delay) {
+        std::this_thread::sleep_for(delay);
+        waits += 1;
+        wait_us += delay.count();
+    }
+
+    std::atomic<bool> enabled{false};
+
+    // backoff in microseconds
+    std::atomic<int64_t> initial_us{1000};
+    std::atomic<int64_t> max_us{100000};
+    std::atomic<int64_t> timeout_us{5000000};
+
+    // sleep time of the operation waiting for the lock, guarded by the database mutex
+    int64_t waited_us{};
+
+    std::atomic<uint64_t> contentions{};
+    std::atomic<uint64_t> waits{};
+    std::atomic<uint64_t> timeouts{};
+    std::atomic<uint64_t> commit_retries{};
+    std::atomic<uint64_t> wait_us{};
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_BUSY_HANDLER_HPP
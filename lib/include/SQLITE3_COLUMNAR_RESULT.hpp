@@ -0,0 +1,352 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_COLUMNAR_RESULT_HPP
+#define SQLITEPLUS_SQLITE3_COLUMNAR_RESULT_HPP
+
+#include <sqlite3.h>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Query result stored column by column in typed buffers
+ *
+ * A column takes the storage class of its values. Integers are widened to
+ * floats, numbers to text and text to blob when a column holds mixed types,
+ * numbers are then rendered the same way SQLite renders them.
+ */
+class SQLITE3_COLUMNAR_RESULT {
+public:
+    enum TYPE {NULL_COLUMN, INTEGER_COLUMN, FLOAT_COLUMN, TEXT_COLUMN, BLOB_COLUMN};
+
+    /**
+     * Buffers of a single column
+     */
+    struct COLUMN {
+        std::string name;
+        TYPE type{NULL_COLUMN};
+
+        std::vector<uint8_t> validity; // one bit per row, LSB first, 1 = not NULL
+        std::vector<int64_t> integers; // INTEGER_COLUMN values
+        std::vector<double> reals; // FLOAT_COLUMN values
+        std::vector<int64_t> offsets; // TEXT_COLUMN/BLOB_COLUMN, row i spans [offsets[i], offsets[i + 1]) of arena
+        std::string arena; // TEXT_COLUMN/BLOB_COLUMN bytes
+    };
+
+    /**
+     * Get the number of rows
+     * @return number of rows
+     */
+    size_t row_count() const {
+        return rows;
+    }
+
+    /**
+     * Get the number of columns
+     * @return number of columns
+     */
+    size_t column_count() const {
+        return columns.size();
+    }
+
+    /**
+     * Get the buffers of a column
+     * @param col column index
+     * @return column
+     * @throw std::out_of_range
+     */
+    const COLUMN &column(size_t col) const {
+        return columns.at(col);
+    }
+
+    /**
+     * Get the name of a column
+     * @param col column index
+     * @return column name
+     * @throw std::out_of_range
+     */
+    const std::string &column_name(size_t col) const {
+        return columns.at(col).name;
+    }
+
+    /**
+     * Get the storage type of a column
+     * @param col column index
+     * @return column type
+     * @throw std::out_of_range
+     */
+    TYPE column_type(size_t col) const {
+        return columns.at(col).type;
+    }
+
+    /**
+     * Check if a cell is NULL
+     * @param row row index
+     * @param col column index
+     * @return true if NULL
+     * @throw std::out_of_range
+     */
+    bool is_null(size_t row, size_t col) const {
+        const COLUMN &c = cell(row, col);
+        return !(c.validity[row >> 3] & (1u << (row & 7)));
+    }
+
+    /**
+     * Get a cell as T, NULL is read as 0 or an empty string
+     * @tparam T int64_t, double or std::string
+     * @param row row index
+     * @param col column index
+     * @return value
+     * @throw std::out_of_range
+     * @throw std::runtime_error if a text or blob column is read as a number
+     */
+    template<typename T>
+    T get(size_t row, size_t col) const;
+
+    /**
+     * Get a pointer into the arena of a text or blob cell, no copy is made
+     * @param row row index
+     * @param col column index
+     * @param length set to the length of the cell in bytes
+     * @return pointer to the cell, not NUL terminated
+     * @throw std::out_of_range
+     * @throw std::runtime_error if the column is not a text or blob column
+     */
+    const char *get_bytes(size_t row, size_t col, size_t &length) const {
+        const COLUMN &c = cell(row, col);
+        if (c.type != TEXT_COLUMN && c.type != BLOB_COLUMN) {
+            throw std::runtime_error("column is not a text or blob column");
+        }
+
+        length = (size_t) (c.offsets[row + 1] - c.offsets[row]);
+        return c.arena.data() + c.offsets[row];
+    }
+
+    /**
+     * \private
+     * Start a new result with the columns of stmt
+     * @param stmt prepared statement
+     */
+    void reset(sqlite3_stmt *stmt) {
+        rows = 0;
+        columns.clear();
+        columns.resize(sqlite3_column_count(stmt));
+        for (size_t i = 0; i < columns.size(); ++i) {
+            const char *name = sqlite3_column_name(stmt, (int) i);
+            columns[i].name = name ? name : "NULL";
+        }
+    }
+
+    /**
+     * \private
+     * Append the current row of stmt
+     * @param stmt statement that just returned SQLITE_ROW
+     */
+    void append_row(sqlite3_stmt *stmt) {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            append_cell(columns[i], stmt, (int) i);
+        }
+        rows += 1;
+    }
+
+private:
+    /**
+     * Bounds checked column lookup
+     */
+    const COLUMN &cell(size_t row, size_t col) const {
+        if (row >= rows) {
+            throw std::out_of_range("row index out of range");
+        }
+        return columns.at(col);
+    }
+
+    /**
+     * Map a sqlite storage class to a column type
+     */
+    static TYPE column_type_of(int sqlite_type) {
+        switch (sqlite_type) {
+            case SQLITE_INTEGER:
+                return INTEGER_COLUMN;
+            case SQLITE_FLOAT:
+                return FLOAT_COLUMN;
+            case SQLITE_TEXT:
+                return TEXT_COLUMN;
+            case SQLITE_BLOB:
+                return BLOB_COLUMN;
+            default:
+                return NULL_COLUMN;
+        }
+    }
+
+    /**
+     * Append one value to a column, widening the column if needed
+     */
+    void append_cell(COLUMN &c, sqlite3_stmt *stmt, int i) {
+        TYPE type = column_type_of(sqlite3_column_type(stmt, i));
+
+        // validity bit
+        if ((rows & 7) == 0) {
+            c.validity.push_back(0);
+        }
+        if (type != NULL_COLUMN) {
+            c.validity.back() |= (uint8_t) (1u << (rows & 7));
+        }
+
+        // widen column, types are ordered from narrowest to widest
+        if (type > c.type) {
+            widen(c, type);
+        }
+
+        switch (c.type) {
+            case NULL_COLUMN:
+                break;
+            case INTEGER_COLUMN:
+                c.integers.push_back(type == NULL_COLUMN ? 0 : sqlite3_column_int64(stmt, i));
+                break;
+            case FLOAT_COLUMN:
+                c.reals.push_back(type == NULL_COLUMN ? 0 : sqlite3_column_double(stmt, i));
+                break;
+            case TEXT_COLUMN:
+            case BLOB_COLUMN:
+                if (type != NULL_COLUMN) {
+                    // column_text renders numbers the way SQLite does
+                    const void *bytes = type == BLOB_COLUMN ? sqlite3_column_blob(stmt, i) : sqlite3_column_text(stmt, i);
+                    if (bytes) {
+                        c.arena.append(reinterpret_cast<const char *>(bytes), (size_t) sqlite3_column_bytes(stmt, i));
+                    }
+                }
+                c.offsets.push_back((int64_t) c.arena.size());
+                break;
+        }
+    }
+
+    /**
+     * Convert the rows already stored in a column to a wider type
+     */
+    void widen(COLUMN &c, TYPE type) {
+        switch (type) {
+            case INTEGER_COLUMN:
+                c.integers.assign(rows, 0);
+                break;
+            case FLOAT_COLUMN:
+                if (c.type == INTEGER_COLUMN) {
+                    c.reals.assign(c.integers.begin(), c.integers.end());
+                } else {
+                    c.reals.assign(rows, 0);
+                }
+                c.integers = std::vector<int64_t>();
+                break;
+            case TEXT_COLUMN:
+            case BLOB_COLUMN:
+                if (c.type == TEXT_COLUMN) {
+                    break;
+                }
+                c.offsets.assign(1, 0);
+                for (size_t row = 0; row < rows; ++row) {
+                    if (c.validity[row >> 3] & (1u << (row & 7))) {
+                        char text[32];
+                        if (c.type == INTEGER_COLUMN) {
+                            sqlite3_snprintf(sizeof(text), text, "%lld", (sqlite3_int64) c.integers[row]);
+                        } else {
+                            sqlite3_snprintf(sizeof(text), text, "%!.15g", c.reals[row]);
+                        }
+                        c.arena += text;
+                    }
+                    c.offsets.push_back((int64_t) c.arena.size());
+                }
+                c.integers = std::vector<int64_t>();
+                c.reals = std::vector<double>();
+                break;
+            case NULL_COLUMN:
+                break;
+        }
+        c.type = type;
+    }
+
+    size_t rows{};
+    std::vector<COLUMN> columns;
+};
+
+/**
+ * Get a cell as int64_t
+ */
+template<>
+inline int64_t SQLITE3_COLUMNAR_RESULT::get<int64_t>(size_t row, size_t col) const {
+    const COLUMN &c = cell(row, col);
+    switch (c.type) {
+        case INTEGER_COLUMN:
+            return c.integers[row];
+        case FLOAT_COLUMN:
+            return (int64_t) c.reals[row];
+        case NULL_COLUMN:
+            return 0;
+        default:
+            throw std::runtime_error("column is not numeric");
+    }
+}
+
+/**
+ * Get a cell as double
+ */
+template<>
+inline double SQLITE3_COLUMNAR_RESULT::get<double>(size_t row, size_t col) const {
+    const COLUMN &c = cell(row, col);
+    switch (c.type) {
+        case INTEGER_COLUMN:
+            return (double) c.integers[row];
+        case FLOAT_COLUMN:
+            return c.reals[row];
+        case NULL_COLUMN:
+            return 0;
+        default:
+            throw std::runtime_error("column is not numeric");
+    }
+}
+
+/**
+ * Get a cell as std::string, numbers are rendered the way SQLite renders them
+ */
+template<>
+inline std::string SQLITE3_COLUMNAR_RESULT::get<std::string>(size_t row, size_t col) const {
+    const COLUMN &c = cell(row, col);
+    if (is_null(row, col)) {
+        return std::string();
+    }
+
+    char text[32];
+    switch (c.type) {
+        case INTEGER_COLUMN:
+            sqlite3_snprintf(sizeof(text), text, "%lld", (sqlite3_int64) c.integers[row]);
+            return text;
+        case FLOAT_COLUMN:
+            sqlite3_snprintf(sizeof(text), text, "%!.15g", c.reals[row]);
+            return text;
+        case TEXT_COLUMN:
+        case BLOB_COLUMN:
+            return c.arena.substr((size_t) c.offsets[row], (size_t) (c.offsets[row + 1] - c.offsets[row]));
+        default:
+            return std::string();
+    }
+}
+
+
+#endif //SQLITEPLUS_SQLITE3_COLUMNAR_RESULT_HPP
@@ -0,0 +1,289 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_CURSOR_HPP
+#define SQLITEPLUS_SQLITE3_CURSOR_HPP
+
+#include <sqlite3.h>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "SQLITE3_ERROR.hpp"
+#include "SQLITE3_STMT_CACHE.hpp"
+
+/**
+ * Forward only cursor over the rows of a query
+ *
+ * Rows are read one at a time with next(), nothing is buffered. The statement is handed back
+ * to the statement cache when the last row was read, when close() is called or when the
+ * cursor is destroyed, whichever comes first.
+ */
+class SQLITE3_CURSOR {
+public:
+    /**
+     * \private
+     * Create a cursor over a prepared statement
+     * @param db database the statement belongs to
+     * @param cache cache to return the statement to, nullptr to finalize it
+     * @param key SQL the statement was acquired from the cache with
+     * @param stmt prepared statement with all parameters bound
+     */
+    SQLITE3_CURSOR(std::shared_ptr<sqlite3 *> db, std::shared_ptr<SQLITE3_STMT_CACHE> cache, std::string key,
+                   sqlite3_stmt *stmt) {
+        this->db = std::move(db);
+        this->cache = std::move(cache);
+        this->key = std::move(key);
+        this->stmt = stmt;
+    }
+
+    /**
+     * \private
+     * Create a cursor that failed before it could run
+     * @param error_no error code
+     * @param err_msg_str error message
+     */
+    SQLITE3_CURSOR(char error_no, std::string err_msg_str) {
+        this->error_no = error_no;
+        this->err_msg_str = std::move(err_msg_str);
+    }
+
+    SQLITE3_CURSOR(const SQLITE3_CURSOR &rhs) = delete;
+
+    SQLITE3_CURSOR &operator=(const SQLITE3_CURSOR &rhs) = delete;
+
+    /**
+     * move construction
+     */
+    SQLITE3_CURSOR(SQLITE3_CURSOR &&rhs) noexcept {
+        *this = std::move(rhs);
+    }
+
+    /**
+     * move assign
+     */
+    SQLITE3_CURSOR &operator=(SQLITE3_CURSOR &&rhs) noexcept {
+        if (this == &rhs) { // self assignment guard
+            return *this;
+        }
+        close();
+
+        db = std::move(rhs.db);
+        cache = std::move(rhs.cache);
+        key = std::move(rhs.key);
+        stmt = rhs.stmt;
+        rhs.stmt = nullptr;
+        error_no = rhs.error_no;
+        error_code = rhs.error_code;
+        err_msg_str = std::move(rhs.err_msg_str);
+
+        return *this;
+    }
+
+    /**
+     * Destructor
+     */
+    ~SQLITE3_CURSOR() {
+        close();
+    }
+
+    /**
+     * Step to the next row
+     * @return true if a row is available, false when done, closed or upon failure
+     */
+    bool next() {
+        if (!stmt) {
+            return false;
+        }
+
+        // other threads using the connection must not replace the error message in between
+        sqlite3 *handle = sqlite3_db_handle(stmt);
+        sqlite3_mutex_enter(sqlite3_db_mutex(handle));
+        int rc = sqlite3_step(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) { // check for error
+            err_msg_str = std::string(sqlite3_errmsg(handle));
+            error_code = rc;
+            error_no = EXECUTION_ERROR;
+        }
+        sqlite3_mutex_leave(sqlite3_db_mutex(handle));
+
+        if (rc == SQLITE_ROW) {
+            return true;
+        }
+        close();
+        return false;
+    }
+
+    /**
+     * Stop reading rows, the statement is reset immediately
+     */
+    void close() {
+        if (!stmt) {
+            return;
+        }
+
+        // statements of a closed or reopened connection cannot be reused
+        if (cache && db && *db == sqlite3_db_handle(stmt)) {
+            cache->release(key, stmt);
+        } else {
+            sqlite3_finalize(stmt);
+        }
+        stmt = nullptr;
+    }
+
+    /**
+     * Check if the cursor can still return rows
+     * @return true until the last row was read, the cursor was closed or an error occurred
+     */
+    bool is_open() const {
+        return stmt != nullptr;
+    }
+
+    /**
+     * Get the number of columns
+     * @return number of columns, 0 once closed
+     */
+    int column_count() const {
+        return stmt ? sqlite3_column_count(stmt) : 0;
+    }
+
+    /**
+     * Get the name of a column
+     * @param col column index
+     * @return column name
+     */
+    std::string column_name(int col) const {
+        const char *name = stmt ? sqlite3_column_name(stmt, col) : nullptr;
+        return std::string(name ? name : "NULL");
+    }
+
+    /**
+     * Check if a column of the current row is NULL
+     * @param col column index
+     * @return true if NULL
+     */
+    bool is_null(int col) const {
+        return sqlite3_column_type(stmt, col) == SQLITE_NULL;
+    }
+
+    /**
+     * Get a column of the current row as T, converted by SQLite if needed
+     * @tparam T int, int64_t, double or std::string
+     * @param col column index
+     * @return value
+     */
+    template<typename T>
+    T get(int col) const;
+
+    /**
+     * Get a pointer to a text or blob column of the current row, valid until the next call to next()
+     * @param col column index
+     * @param length set to the length in bytes
+     * @return pointer to the bytes, nullptr for NULL
+     */
+    const char *get_bytes(int col, size_t &length) const {
+        auto bytes = reinterpret_cast<const char *>(sqlite3_column_type(stmt, col) == SQLITE_BLOB ?
+                                                    sqlite3_column_blob(stmt, col) : sqlite3_column_text(stmt, col));
+        length = (size_t) sqlite3_column_bytes(stmt, col);
+        return bytes;
+    }
+
+    /**
+     * Get the underlying statement, allowing user to read columns with the sqlite3_column_* functions
+     * @return statement, nullptr once closed
+     */
+    sqlite3_stmt *get_stmt() const {
+        return stmt;
+    }
+
+    /**
+     * Read the cursor error_no and print parsed error to std::cerr
+     */
+    void perror() {
+        switch (error_no) {
+            case NO_ERROR:
+                break;
+            case QUERY_BINDING_ERROR:
+                std::cerr << "Query Binding Failed\n";
+                break;
+            case UNINITIALIZED_ERROR:
+                std::cerr << "No database connected\n";
+                break;
+            default:
+                std::cerr << err_msg_str << std::endl;
+                break;
+        }
+
+        error_no = NO_ERROR;
+    }
+
+public:
+    char error_no{}; // cursor error code
+
+private:
+    friend class SQLITE3;
+    friend class SQLITE3_ARROW_READER;
+
+    std::shared_ptr<sqlite3 *> db;
+    std::shared_ptr<SQLITE3_STMT_CACHE> cache;
+    std::string key;
+    sqlite3_stmt *stmt{};
+    std::string err_msg_str;
+    int error_code{}; // sqlite return code of the failed step
+};
+
+/**
+ * Get a column as int
+ */
+template<>
+inline int SQLITE3_CURSOR::get<int>(int col) const {
+    return sqlite3_column_int(stmt, col);
+}
+
+/**
+ * Get a column as int64_t
+ */
+template<>
+inline int64_t SQLITE3_CURSOR::get<int64_t>(int col) const {
+    return sqlite3_column_int64(stmt, col);
+}
+
+/**
+ * Get a column as double
+ */
+template<>
+inline double SQLITE3_CURSOR::get<double>(int col) const {
+    return sqlite3_column_double(stmt, col);
+}
+
+/**
+ * Get a column as std::string, NULL is read as an empty string
+ */
+template<>
+inline std::string SQLITE3_CURSOR::get<std::string>(int col) const {
+    size_t length;
+    const char *bytes = get_bytes(col, length);
+    return bytes ? std::string(bytes, length) : std::string();
+}
+
+
+#endif //SQLITEPLUS_SQLITE3_CURSOR_HPP
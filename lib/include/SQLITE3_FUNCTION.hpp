@@ -0,0 +1,346 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_FUNCTION_HPP
+#define SQLITEPLUS_SQLITE3_FUNCTION_HPP
+
+#include <sqlite3.h>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * \private
+ * Argument and return types of a callable: lambda, function pointer or member function pointer
+ */
+template<typename F>
+struct SQLITE3_CALLABLE : SQLITE3_CALLABLE<decltype(&F::operator())> {
+};
+
+template<typename R, typename... A>
+struct SQLITE3_CALLABLE<R (*)(A...)> {
+    typedef std::function<R(A...)> FUNCTION;
+    static const size_t ARITY = sizeof...(A);
+};
+
+template<typename C, typename R, typename... A>
+struct SQLITE3_CALLABLE<R (C::*)(A...)> {
+    typedef std::function<R(A...)> FUNCTION;
+    static const size_t ARITY = sizeof...(A);
+};
+
+template<typename C, typename R, typename... A>
+struct SQLITE3_CALLABLE<R (C::*)(A...) const> {
+    typedef std::function<R(A...)> FUNCTION;
+    static const size_t ARITY = sizeof...(A);
+};
+
+/**
+ * \private
+ * Registers user defined functions with typed arguments and results
+ *
+ * Arguments are read with the sqlite3_value_* function matching their type: integral,
+ * floating point, std::string, std::vector<uint8_t> (blob) or sqlite3_value * (as is).
+ * Results are set the same way, void and nullptr_t return NULL. An exception thrown by
+ * the function fails the statement with its message.
+ */
+class SQLITE3_FUNCTION {
+public:
+    /**
+     * Raw scalar function, reads sqlite3_value and sets the result of the context itself
+     */
+    typedef std::function<void(sqlite3_context *, int, sqlite3_value **)> RAW_FUNCTION;
+
+    /**
+     * Register a raw scalar function
+     * @param db connection
+     * @param name name of function
+     * @param argc number of arguments, -1 for any
+     * @param function implementation, owned by the connection
+     * @param flags SQLITE_DETERMINISTIC, SQLITE_INNOCUOUS or SQLITE_DIRECTONLY, or 0
+     * @return sqlite return code
+     */
+    static int create_raw(sqlite3 *db, const std::string &name, int argc, RAW_FUNCTION function, int flags) {
+        return sqlite3_create_function_v2(db, name.c_str(), argc, SQLITE_UTF8 | flags,
+                                          new RAW_FUNCTION(std::move(function)), &call_raw, nullptr, nullptr,
+                                          &destroy<RAW_FUNCTION>);
+    }
+
+    /**
+     * Register a typed scalar function
+     * @param db connection
+     * @param name name of function
+     * @param function implementation, owned by the connection
+     * @param flags SQLITE_DETERMINISTIC, SQLITE_INNOCUOUS or SQLITE_DIRECTONLY, or 0
+     * @return sqlite return code
+     */
+    template<typename R, typename... A>
+    static int create_scalar(sqlite3 *db, const std::string &name, std::function<R(A...)> function, int flags) {
+        typedef std::function<R(A...)> FUNCTION;
+        return sqlite3_create_function_v2(db, name.c_str(), (int) sizeof...(A), SQLITE_UTF8 | flags,
+                                          new FUNCTION(std::move(function)), &call_scalar<R, A...>, nullptr,
+                                          nullptr, &destroy<FUNCTION>);
+    }
+
+    /**
+     * Register an aggregate function, one AGGREGATE is constructed per group
+     * @tparam AGGREGATE default constructible class with void step(args...) and result final()
+     * @param db connection
+     * @param name name of function
+     * @param flags SQLITE_DETERMINISTIC, SQLITE_INNOCUOUS or SQLITE_DIRECTONLY, or 0
+     * @return sqlite return code
+     */
+    template<typename AGGREGATE>
+    static int create_aggregate(sqlite3 *db, const std::string &name, int flags) {
+        return sqlite3_create_function_v2(db, name.c_str(),
+                                          (int) SQLITE3_CALLABLE<decltype(&AGGREGATE::step)>::ARITY,
+                                          SQLITE_UTF8 | flags, nullptr, nullptr, &call_step<AGGREGATE, STEP>,
+                                          &call_final<AGGREGATE>, nullptr);
+    }
+
+    /**
+     * Register an aggregate window function, one AGGREGATE is constructed per partition
+     * @tparam AGGREGATE default constructible class with void step(args...), void inverse(args...)
+     *                   taking the same arguments, result value() and result final()
+     * @param db connection
+     * @param name name of function
+     * @param flags SQLITE_DETERMINISTIC, SQLITE_INNOCUOUS or SQLITE_DIRECTONLY, or 0
+     * @return sqlite return code
+     */
+    template<typename AGGREGATE>
+    static int create_window(sqlite3 *db, const std::string &name, int flags) {
+        return sqlite3_create_window_function(db, name.c_str(),
+                                              (int) SQLITE3_CALLABLE<decltype(&AGGREGATE::step)>::ARITY,
+                                              SQLITE_UTF8 | flags, nullptr, &call_step<AGGREGATE, STEP>,
+                                              &call_final<AGGREGATE>, &call_value<AGGREGATE>,
+                                              &call_step<AGGREGATE, INVERSE>, nullptr);
+    }
+
+private:
+    template<size_t... I>
+    struct INDICES {
+    };
+
+    template<size_t N, size_t... I>
+    struct SEQUENCE : SEQUENCE<N - 1, N - 1, I...> {
+    };
+
+    template<size_t... I>
+    struct SEQUENCE<0, I...> {
+        typedef INDICES<I...> type;
+    };
+
+    /**
+     * Adds a row to the state of an aggregate
+     */
+    struct STEP {
+        template<typename AGGREGATE, typename... A>
+        static void call(AGGREGATE &aggregate, A &&... args) {
+            aggregate.step(std::forward<A>(args)...);
+        }
+    };
+
+    /**
+     * Removes a row from the state of a window function
+     */
+    struct INVERSE {
+        template<typename AGGREGATE, typename... A>
+        static void call(AGGREGATE &aggregate, A &&... args) {
+            aggregate.inverse(std::forward<A>(args)...);
+        }
+    };
+
+    /**
+     * xDestroy of registered functions
+     */
+    template<typename T>
+    static void destroy(void *function) {
+        delete reinterpret_cast<T *>(function);
+    }
+
+    static void call_raw(sqlite3_context *context, int argc, sqlite3_value **argv) {
+        try {
+            (*reinterpret_cast<RAW_FUNCTION *>(sqlite3_user_data(context)))(context, argc, argv);
+        } catch (...) {
+            report(context);
+        }
+    }
+
+    template<typename R, typename... A>
+    static void call_scalar(sqlite3_context *context, int, sqlite3_value **argv) {
+        try {
+            auto &function = *reinterpret_cast<std::function<R(A...)> *>(sqlite3_user_data(context));
+            invoke(context, function, argv, typename SEQUENCE<sizeof...(A)>::type(), std::is_void<R>());
+        } catch (...) {
+            report(context);
+        }
+    }
+
+    /**
+     * xStep and xInverse, the state of the group is created by the first row
+     */
+    template<typename AGGREGATE, typename METHOD>
+    static void call_step(sqlite3_context *context, int, sqlite3_value **argv) {
+        typedef decltype(&AGGREGATE::step) SIGNATURE;
+        try {
+            auto **state = reinterpret_cast<AGGREGATE **>(sqlite3_aggregate_context(context, sizeof(AGGREGATE *)));
+            if (!state) {
+                sqlite3_result_error_nomem(context);
+                return;
+            }
+            if (!*state) {
+                *state = new AGGREGATE();
+            }
+            apply<METHOD>(**state, argv, SIGNATURE(), typename SEQUENCE<SQLITE3_CALLABLE<SIGNATURE>::ARITY>::type());
+        } catch (...) {
+            report(context);
+        }
+    }
+
+    /**
+     * xValue, the current result of a window
+     */
+    template<typename AGGREGATE>
+    static void call_value(sqlite3_context *context) {
+        try {
+            auto **state = reinterpret_cast<AGGREGATE **>(sqlite3_aggregate_context(context, 0));
+            if (state && *state) {
+                set_result(context, (*state)->value());
+            } else {
+                AGGREGATE empty;
+                set_result(context, empty.value());
+            }
+        } catch (...) {
+            report(context);
+        }
+    }
+
+    /**
+     * xFinal, also run to clean up after a failure
+     */
+    template<typename AGGREGATE>
+    static void call_final(sqlite3_context *context) {
+        auto **state = reinterpret_cast<AGGREGATE **>(sqlite3_aggregate_context(context, 0));
+        AGGREGATE *aggregate = state ? *state : nullptr;
+        try {
+            if (aggregate) {
+                set_result(context, aggregate->final());
+            } else { // no row in the group
+                AGGREGATE empty;
+                set_result(context, empty.final());
+            }
+        } catch (...) {
+            report(context);
+        }
+        delete aggregate;
+    }
+
+    template<typename R, typename... A, size_t... I>
+    static void invoke(sqlite3_context *context, std::function<R(A...)> &function, sqlite3_value **argv,
+                       INDICES<I...>, std::false_type) {
+        set_result(context, function(get(argv[I], (typename std::decay<A>::type *) nullptr)...));
+    }
+
+    template<typename... A, size_t... I>
+    static void invoke(sqlite3_context *, std::function<void(A...)> &function, sqlite3_value **argv,
+                       INDICES<I...>, std::true_type) {
+        function(get(argv[I], (typename std::decay<A>::type *) nullptr)...);
+    }
+
+    template<typename METHOD, typename AGGREGATE, typename... A, size_t... I>
+    static void apply(AGGREGATE &aggregate, sqlite3_value **argv, void (AGGREGATE::*)(A...), INDICES<I...>) {
+        METHOD::call(aggregate, get(argv[I], (typename std::decay<A>::type *) nullptr)...);
+    }
+
+    /**
+     * Fail the statement with the message of the current exception
+     */
+    static void report(sqlite3_context *context) {
+        try {
+            throw;
+        } catch (std::bad_alloc &) {
+            sqlite3_result_error_nomem(context);
+        } catch (std::exception &e) {
+            sqlite3_result_error(context, e.what(), -1);
+        } catch (...) {
+            sqlite3_result_error(context, "Unknown exception in user defined function", -1);
+        }
+    }
+
+    template<typename V>
+    static typename std::enable_if<std::is_integral<V>::value, V>::type get(sqlite3_value *value, V *) {
+        return (V) sqlite3_value_int64(value);
+    }
+
+    template<typename V>
+    static typename std::enable_if<std::is_floating_point<V>::value, V>::type get(sqlite3_value *value, V *) {
+        return (V) sqlite3_value_double(value);
+    }
+
+    static std::string get(sqlite3_value *value, std::string *) {
+        auto text = reinterpret_cast<const char *>(sqlite3_value_text(value));
+        return text ? std::string(text, (size_t) sqlite3_value_bytes(value)) : std::string();
+    }
+
+    static std::vector<uint8_t> get(sqlite3_value *value, std::vector<uint8_t> *) {
+        auto bytes = reinterpret_cast<const uint8_t *>(sqlite3_value_blob(value));
+        return std::vector<uint8_t>(bytes, bytes + (bytes ? sqlite3_value_bytes(value) : 0));
+    }
+
+    static sqlite3_value *get(sqlite3_value *value, sqlite3_value **) {
+        return value;
+    }
+
+public:
+    /**
+     * \private
+     * Set the result of a function or of a virtual table column
+     */
+    template<typename V>
+    static typename std::enable_if<std::is_integral<V>::value>::type set_result(sqlite3_context *context, V value) {
+        sqlite3_result_int64(context, (sqlite3_int64) value);
+    }
+
+    template<typename V>
+    static typename std::enable_if<std::is_floating_point<V>::value>::type
+    set_result(sqlite3_context *context, V value) {
+        sqlite3_result_double(context, (double) value);
+    }
+
+    static void set_result(sqlite3_context *context, const std::string &value) {
+        sqlite3_result_text64(context, value.data(), value.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+    }
+
+    static void set_result(sqlite3_context *context, const std::vector<uint8_t> &value) {
+        sqlite3_result_blob64(context, value.data(), value.size(), SQLITE_TRANSIENT);
+    }
+
+    static void set_result(sqlite3_context *context, std::nullptr_t) {
+        sqlite3_result_null(context);
+    }
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_FUNCTION_HPP
@@ -0,0 +1,440 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_MAINTENANCE_HPP
+#define SQLITEPLUS_SQLITE3_MAINTENANCE_HPP
+
+#include <sqlite3.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "SQLITE3.hpp"
+
+/**
+ * Statistics of a maintenance thread
+ */
+struct SQLITE3_MAINTENANCE_STATS {
+    uint64_t checkpoints{}; // completed checkpoints, of any mode
+    uint64_t escalations{}; // completed RESTART or TRUNCATE checkpoints
+    uint64_t busy{}; // checkpoints or vacuums that could not complete, because another connection was in the way
+    uint64_t failures{}; // checkpoints, optimizations or vacuums that failed otherwise
+    uint64_t frames_checkpointed{}; // WAL frames copied into the database by the checkpoints
+    int64_t wal_frames{-1}; // frames in the WAL after the last checkpoint, -1 if not in WAL mode
+    std::chrono::microseconds checkpoint_time{0}; // total run time of the checkpoints
+    std::chrono::microseconds max_checkpoint_time{0}; // slowest checkpoint
+    uint64_t optimizations{}; // PRAGMA optimize runs
+    uint64_t vacuums{}; // PRAGMA incremental_vacuum runs
+};
+
+/**
+ * Background thread keeping the WAL of a connection small and its statistics fresh
+ *
+ * Every interval the WAL is checkpointed with SQLITE_CHECKPOINT_PASSIVE. The checkpoint is escalated
+ * to SQLITE_CHECKPOINT_RESTART once the WAL is larger than the size limit, so that writers start
+ * over at its beginning, and to SQLITE_CHECKPOINT_TRUNCATE once nothing was written for the idle time.
+ * PRAGMA optimize and PRAGMA incremental_vacuum run at their own, longer intervals.
+ *
+ * Checkpoints and PRAGMA incremental_vacuum run on a connection of their own, without busy handler, and
+ * are tried again next round when another connection is in the way. The transaction of the connection
+ * is never ended from the maintenance thread: PRAGMA optimize, which relies on the query planner
+ * statistics of the connection, only runs in rounds finding it in autocommit mode. SQLITE3 keeps a
+ * transaction open between commits, so it is skipped until the application leaves it with COMMIT.
+ * The connection must be opened with SQLITE_OPEN_FULLMUTEX, which is the default, and must not be
+ * closed before the maintenance is destroyed.
+ * @code
+ * SQLITE3 db("app.db", SQLITE3_OPTIONS::read_mostly());
+ * SQLITE3_MAINTENANCE maintenance(db);
+ * maintenance.set_wal_size_limit(64 * 1024 * 1024);
+ * @endcode
+ */
+class SQLITE3_MAINTENANCE {
+public:
+    /**
+     * Constructor, start the maintenance thread
+     * @param db connection to maintain
+     * @param interval time between rounds
+     */
+    explicit SQLITE3_MAINTENANCE(const SQLITE3 &db, std::chrono::milliseconds interval = std::chrono::seconds(1))
+            : db(db.db) {
+        this->interval = interval.count() > 0 ? interval : std::chrono::milliseconds(1);
+        last_write = last_optimize = last_vacuum = std::chrono::steady_clock::now();
+
+        worker = std::thread(&SQLITE3_MAINTENANCE::run, this);
+    }
+
+    SQLITE3_MAINTENANCE(const SQLITE3_MAINTENANCE &rhs) = delete;
+
+    SQLITE3_MAINTENANCE &operator=(const SQLITE3_MAINTENANCE &rhs) = delete;
+
+    /**
+     * Destructor, stop the maintenance thread
+     */
+    ~SQLITE3_MAINTENANCE() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        sqlite3_close(dedicated);
+    }
+
+    /**
+     * Set the WAL size above which checkpoints are escalated to SQLITE_CHECKPOINT_RESTART
+     * @param bytes size limit, 0 never escalates, 16 MiB by default
+     */
+    void set_wal_size_limit(int64_t bytes) {
+        std::lock_guard<std::mutex> guard(lock);
+        wal_size_limit = bytes;
+    }
+
+    /**
+     * Get the WAL size above which checkpoints are escalated to SQLITE_CHECKPOINT_RESTART
+     * @return size limit in bytes
+     */
+    int64_t get_wal_size_limit() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return wal_size_limit;
+    }
+
+    /**
+     * Set the time without writes after which the WAL is truncated with SQLITE_CHECKPOINT_TRUNCATE
+     * @param idle idle time, 5 seconds by default
+     */
+    void set_idle_time(std::chrono::milliseconds idle) {
+        std::lock_guard<std::mutex> guard(lock);
+        idle_time = idle;
+    }
+
+    /**
+     * Get the time without writes after which the WAL is truncated
+     * @return idle time
+     */
+    std::chrono::milliseconds get_idle_time() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return idle_time;
+    }
+
+    /**
+     * Set the time between two runs of PRAGMA optimize
+     * @param every interval, 0 disables it, 1 hour by default
+     */
+    void set_optimize_interval(std::chrono::milliseconds every) {
+        std::lock_guard<std::mutex> guard(lock);
+        optimize_interval = every;
+    }
+
+    /**
+     * Set the time between two runs of PRAGMA incremental_vacuum, which only frees pages of
+     * databases created with PRAGMA auto_vacuum = INCREMENTAL
+     * @param every interval, 0 disables it, 10 minutes by default
+     * @param pages free pages released per run, 0 releases all of them
+     */
+    void set_vacuum_interval(std::chrono::milliseconds every, int pages = 1000) {
+        std::lock_guard<std::mutex> guard(lock);
+        vacuum_interval = every;
+        vacuum_pages = pages > 0 ? pages : 0;
+    }
+
+    /**
+     * Run a round now, on the calling thread
+     * @return 0 upon success, 1 if the connection was busy or a step failed
+     */
+    int maintain() {
+        std::lock_guard<std::mutex> round_guard(round);
+        auto now = std::chrono::steady_clock::now();
+
+        // settings of this round
+        int64_t size_limit;
+        std::chrono::milliseconds idle_limit, optimize_every, vacuum_every;
+        int pages;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            size_limit = wal_size_limit;
+            idle_limit = idle_time;
+            optimize_every = optimize_interval;
+            vacuum_every = vacuum_interval;
+            pages = vacuum_pages;
+        }
+
+        int rc = 0;
+        sqlite3 *own;
+        {
+            CONNECTION_LOCK application(*db);
+            own = dedicated_connection(application.handle);
+
+            // the statistics PRAGMA optimize relies on belong to the connection, it must not run
+            // within a transaction of the application
+            if (optimize_every.count() > 0 && now - last_optimize >= optimize_every && application.handle &&
+                sqlite3_get_autocommit(application.handle)) {
+                last_optimize = now;
+                rc = run_pragma(application.handle, "PRAGMA optimize;", &SQLITE3_MAINTENANCE_STATS::optimizations);
+            }
+        }
+        if (!own) {
+            return fail();
+        }
+
+        // frames appended since the last round mean the database is in use
+        int64_t frames_before = last_frames;
+        int passive = run_checkpoint(own, SQLITE_CHECKPOINT_PASSIVE);
+        if (last_frames != frames_before) {
+            last_write = now;
+        }
+        rc |= passive;
+
+        if (!passive && last_frames > 0) {
+            if (now - last_write >= idle_limit) {
+                rc |= run_checkpoint(own, SQLITE_CHECKPOINT_TRUNCATE);
+            } else if (size_limit > 0 && last_frames * page_size(own) >= size_limit) {
+                rc |= run_checkpoint(own, SQLITE_CHECKPOINT_RESTART);
+            }
+        }
+
+        if (vacuum_every.count() > 0 && now - last_vacuum >= vacuum_every) {
+            last_vacuum = now;
+            rc |= run_pragma(own, "PRAGMA incremental_vacuum(" + std::to_string(pages) + ");",
+                             &SQLITE3_MAINTENANCE_STATS::vacuums);
+        }
+        return rc;
+    }
+
+    /**
+     * Checkpoint the WAL now, on the calling thread
+     * @param mode SQLITE_CHECKPOINT_PASSIVE, SQLITE_CHECKPOINT_FULL, SQLITE_CHECKPOINT_RESTART
+     *             or SQLITE_CHECKPOINT_TRUNCATE
+     * @return 0 upon success, 1 if the connection was busy or the checkpoint failed
+     */
+    int checkpoint(int mode = SQLITE_CHECKPOINT_PASSIVE) {
+        std::lock_guard<std::mutex> round_guard(round);
+
+        sqlite3 *own;
+        {
+            CONNECTION_LOCK application(*db);
+            own = dedicated_connection(application.handle);
+        }
+
+        // all modes but PASSIVE invoke the busy handler, they run on a connection without one
+        return own ? run_checkpoint(own, mode) : fail();
+    }
+
+    /**
+     * Get the statistics collected so far
+     * @return statistics
+     */
+    SQLITE3_MAINTENANCE_STATS get_stats() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+
+private:
+    /**
+     * Hold the mutex of the connection of the application, statements of other threads wait
+     */
+    struct CONNECTION_LOCK {
+        explicit CONNECTION_LOCK(sqlite3 *connection) : handle(connection) {
+            if (connection) {
+                mutex = sqlite3_db_mutex(connection);
+                sqlite3_mutex_enter(mutex);
+            }
+        }
+
+        ~CONNECTION_LOCK() {
+            sqlite3_mutex_leave(mutex);
+        }
+
+        CONNECTION_LOCK(const CONNECTION_LOCK &) = delete;
+        CONNECTION_LOCK &operator=(const CONNECTION_LOCK &) = delete;
+
+        sqlite3 *handle; // nullptr if the connection is closed
+        sqlite3_mutex *mutex{};
+    };
+
+    /**
+     * Get the connection running checkpoints and vacuums, round must be held
+     *
+     * It has no busy handler, a statement finding the database locked fails at once and is
+     * tried again next round
+     * @param handle locked connection of the application, the connection is opened on its main database
+     * @return connection, nullptr for closed or in-memory databases or if it cannot be opened
+     */
+    sqlite3 *dedicated_connection(sqlite3 *handle) {
+        const char *file = handle ? sqlite3_db_filename(handle, "main") : nullptr;
+        if (!file || !*file) {
+            return nullptr;
+        }
+        if (dedicated && dedicated_file == file) {
+            return dedicated;
+        }
+
+        // the connection was opened again, possibly on another database, checkpoints of a
+        // connection that has not read the database yet do nothing as its WAL is not open
+        sqlite3_close(dedicated);
+        dedicated = nullptr;
+        if (sqlite3_open_v2(file, &dedicated, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK ||
+            sqlite3_exec(dedicated, "SELECT COUNT(*) FROM sqlite_master;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            sqlite3_close(dedicated);
+            dedicated = nullptr;
+            return nullptr;
+        }
+        dedicated_file = file;
+        return dedicated;
+    }
+
+    /**
+     * Count a step that could not run
+     * @return 1
+     */
+    int fail() {
+        std::lock_guard<std::mutex> guard(lock);
+        stats.failures += 1;
+        return 1;
+    }
+
+    /**
+     * Maintenance thread
+     */
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!wake.wait_for(guard, interval, [this] { return stopping; })) {
+            guard.unlock();
+            maintain();
+            guard.lock();
+        }
+    }
+
+    /**
+     * Run a checkpoint and record it, round must be held
+     * @param handle dedicated connection
+     * @param mode checkpoint mode
+     * @return 0 upon success, 1 upon failure
+     */
+    int run_checkpoint(sqlite3 *handle, int mode) {
+        int log = -1;
+        int checkpointed = -1;
+        auto start = std::chrono::steady_clock::now();
+        int rc = sqlite3_wal_checkpoint_v2(handle, "main", mode, &log, &checkpointed);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        // frames copied by this checkpoint, SQLite's own checkpoints on commit are counted as well
+        uint64_t moved = 0;
+        if (rc == SQLITE_OK && log >= 0) {
+            if (mode == SQLITE_CHECKPOINT_TRUNCATE) { // the WAL is empty now
+                moved = last_frames > backfilled ? (uint64_t) (last_frames - backfilled) : 0;
+                backfilled = 0;
+            } else {
+                if (log < last_frames || checkpointed < backfilled) { // writers started over
+                    backfilled = 0;
+                }
+                moved = (uint64_t) (checkpointed - backfilled);
+                backfilled = checkpointed;
+            }
+            last_frames = log;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (rc == SQLITE_BUSY) {
+            stats.busy += 1;
+            return 1;
+        }
+        if (rc != SQLITE_OK) {
+            stats.failures += 1;
+            return 1;
+        }
+
+        stats.checkpoints += 1;
+        stats.escalations += mode == SQLITE_CHECKPOINT_RESTART || mode == SQLITE_CHECKPOINT_TRUNCATE;
+        stats.frames_checkpointed += moved;
+        stats.wal_frames = log;
+        stats.checkpoint_time += elapsed;
+        stats.max_checkpoint_time = elapsed > stats.max_checkpoint_time ? elapsed : stats.max_checkpoint_time;
+        return 0;
+    }
+
+    /**
+     * Run a maintenance statement and count it, round must be held
+     * @param handle connection of the application or dedicated connection
+     * @param sql statement
+     * @param counter statistic counting the successful runs
+     * @return 0 upon success, 1 upon failure
+     */
+    int run_pragma(sqlite3 *handle, const std::string &sql, uint64_t SQLITE3_MAINTENANCE_STATS::*counter) {
+        int rc = sqlite3_exec(handle, sql.c_str(), nullptr, nullptr, nullptr);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (rc != SQLITE_OK) {
+            stats.busy += rc == SQLITE_BUSY;
+            stats.failures += rc != SQLITE_BUSY;
+            return 1;
+        }
+        stats.*counter += 1;
+        return 0;
+    }
+
+    /**
+     * Get the page size of the main database
+     * @param handle dedicated connection
+     * @return page size in bytes
+     */
+    static int64_t page_size(sqlite3 *handle) {
+        sqlite3_stmt *stmt = nullptr;
+        int64_t size = 4096;
+        if (sqlite3_prepare_v2(handle, "PRAGMA page_size;", -1, &stmt, nullptr) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW) {
+            size = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        return size;
+    }
+
+    std::shared_ptr<sqlite3 *> db;
+    std::thread worker;
+    std::chrono::milliseconds interval;
+
+    // settings
+    int64_t wal_size_limit{16 * 1024 * 1024};
+    std::chrono::milliseconds idle_time{std::chrono::seconds(5)};
+    std::chrono::milliseconds optimize_interval{std::chrono::hours(1)};
+    std::chrono::milliseconds vacuum_interval{std::chrono::minutes(10)};
+    int vacuum_pages{1000};
+
+    // state of the rounds, guarded by round
+    std::chrono::steady_clock::time_point last_write;
+    std::chrono::steady_clock::time_point last_optimize;
+    std::chrono::steady_clock::time_point last_vacuum;
+    int64_t last_frames{-1};
+    int64_t backfilled{};
+    sqlite3 *dedicated{}; // checkpoints and vacuums, without busy handler
+    std::string dedicated_file;
+    std::mutex round;
+
+    bool stopping{};
+    SQLITE3_MAINTENANCE_STATS stats;
+    mutable std::mutex lock;
+    std::condition_variable wake;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_MAINTENANCE_HPP
@@ -0,0 +1,152 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_OPTIONS_HPP
+#define SQLITEPLUS_SQLITE3_OPTIONS_HPP
+
+#include <sqlite3.h>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Connection settings applied when a database is opened
+ *
+ * Empty strings and UNSET numbers keep the SQLite default, so a default constructed
+ * SQLITE3_OPTIONS opens the database the same way sqlite3_open does.
+ */
+struct SQLITE3_OPTIONS {
+    static const int64_t UNSET = std::numeric_limits<int64_t>::min();
+
+    // sqlite3_open_v2 flags, SQLITE_OPEN_FULLMUTEX is added unless SQLITE_OPEN_NOMUTEX is given,
+    // which is only safe for connections never used by several threads at once
+    int open_flags{SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE};
+    std::string journal_mode; // DELETE, TRUNCATE, PERSIST, MEMORY, WAL or OFF
+    std::string synchronous; // OFF, NORMAL, FULL or EXTRA
+    std::string temp_store; // DEFAULT, FILE or MEMORY
+    int64_t cache_size{UNSET}; // pages, or KiB if negative
+    int64_t mmap_size{UNSET}; // bytes of the database file to memory map
+    int64_t page_size{UNSET}; // bytes, only applies to new databases
+    int64_t busy_timeout{UNSET}; // milliseconds to wait for a lock held by another connection
+
+    /**
+     * Preset for loading large amounts of data, not durable if the machine crashes during the load
+     * @return options
+     */
+    static SQLITE3_OPTIONS bulk_load() {
+        SQLITE3_OPTIONS options;
+        options.journal_mode = "MEMORY";
+        options.synchronous = "OFF";
+        options.temp_store = "MEMORY";
+        options.cache_size = -262144; // 256 MiB
+        options.busy_timeout = 5000;
+        return options;
+    }
+
+    /**
+     * Preset for databases read far more often than written, readers do not block the writer
+     * @return options
+     */
+    static SQLITE3_OPTIONS read_mostly() {
+        SQLITE3_OPTIONS options;
+        options.journal_mode = "WAL";
+        options.synchronous = "NORMAL";
+        options.temp_store = "MEMORY";
+        options.cache_size = -65536; // 64 MiB
+        options.mmap_size = 268435456; // 256 MiB
+        options.busy_timeout = 5000;
+        return options;
+    }
+
+    /**
+     * Preset for data that must survive a power loss once committed
+     * @return options
+     */
+    static SQLITE3_OPTIONS durable() {
+        SQLITE3_OPTIONS options;
+        options.journal_mode = "WAL";
+        options.synchronous = "FULL";
+        options.busy_timeout = 5000;
+        return options;
+    }
+
+    /**
+     * Get a preset by name
+     * @param name "default", "bulk-load", "read-mostly" or "durable"
+     * @return options
+     * @throw std::invalid_argument if there is no such preset
+     */
+    static SQLITE3_OPTIONS preset(const std::string &name) {
+        if (name == "default") {
+            return SQLITE3_OPTIONS();
+        }
+        if (name == "bulk-load") {
+            return bulk_load();
+        }
+        if (name == "read-mostly") {
+            return read_mostly();
+        }
+        if (name == "durable") {
+            return durable();
+        }
+        throw std::invalid_argument("Unknown preset " + name);
+    }
+
+    /**
+     * Apply the settings to an open connection, must be called outside of a transaction
+     * @param db connection
+     * @return SQLITE_OK upon success, sqlite error code upon failure
+     */
+    int apply(sqlite3 *db) const {
+        if (busy_timeout != UNSET) {
+            int rc = sqlite3_busy_timeout(db, (int) busy_timeout);
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+        }
+
+        // page_size must come before journal_mode, WAL databases cannot change their page size
+        std::string pragmas;
+        if (page_size != UNSET) {
+            pragmas += "PRAGMA page_size=" + std::to_string(page_size) + ";";
+        }
+        if (!journal_mode.empty()) {
+            pragmas += "PRAGMA journal_mode=" + journal_mode + ";";
+        }
+        if (!synchronous.empty()) {
+            pragmas += "PRAGMA synchronous=" + synchronous + ";";
+        }
+        if (!temp_store.empty()) {
+            pragmas += "PRAGMA temp_store=" + temp_store + ";";
+        }
+        if (cache_size != UNSET) {
+            pragmas += "PRAGMA cache_size=" + std::to_string(cache_size) + ";";
+        }
+        if (mmap_size != UNSET) {
+            pragmas += "PRAGMA mmap_size=" + std::to_string(mmap_size) + ";";
+        }
+
+        return pragmas.empty() ? SQLITE_OK : sqlite3_exec(db, pragmas.c_str(), nullptr, nullptr, nullptr);
+    }
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_OPTIONS_HPP
@@ -0,0 +1,365 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_POOL_HPP
+#define SQLITEPLUS_SQLITE3_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "SQLITE3.hpp"
+
+/**
+ * Pool of connections to the same database in WAL mode
+ *
+ * Every connection has its own handle, so threads holding different
+ * connections read in parallel. The pool must outlive all
+ * connections checked out of it.
+ */
+class SQLITE3_POOL {
+public:
+    /**
+     * Connection checked out of a pool, returned to the pool when destroyed
+     */
+    class CONNECTION {
+    public:
+        /**
+         * \private
+         */
+        CONNECTION(SQLITE3_POOL *pool, SQLITE3 *db) {
+            this->pool = pool;
+            this->db = db;
+        }
+
+        CONNECTION(const CONNECTION &rhs) = delete;
+
+        CONNECTION &operator=(const CONNECTION &rhs) = delete;
+
+        /**
+         * move construction
+         */
+        CONNECTION(CONNECTION &&rhs) noexcept {
+            pool = rhs.pool;
+            db = rhs.db;
+            rhs.db = nullptr;
+        }
+
+        /**
+         * move assign
+         */
+        CONNECTION &operator=(CONNECTION &&rhs) noexcept {
+            if (this == &rhs) { // self assignment guard
+                return *this;
+            }
+            release();
+
+            pool = rhs.pool;
+            db = rhs.db;
+            rhs.db = nullptr;
+            return *this;
+        }
+
+        /**
+         * Destructor, return connection to pool
+         */
+        ~CONNECTION() {
+            release();
+        }
+
+        /**
+         * Return connection to pool before the handle is destroyed
+         */
+        void release() {
+            if (db) {
+                pool->release(db);
+                db = nullptr;
+            }
+        }
+
+        SQLITE3 *operator->() const {
+            return db;
+        }
+
+        SQLITE3 &operator*() const {
+            return *db;
+        }
+
+    private:
+        SQLITE3_POOL *pool;
+        SQLITE3 *db;
+    };
+
+    /**
+     * Constructor, open size connections to db_name and switch the database to WAL mode
+     * @param db_name name of database to open
+     * @param size number of connections
+     * @param options settings applied to every connection, journal_mode is always WAL
+     * @throw std::runtime_error if a connection cannot be opened
+     */
+    SQLITE3_POOL(const std::string &db_name, size_t size,
+                 SQLITE3_OPTIONS options = SQLITE3_OPTIONS::read_mostly()) {
+        if (size == 0) {
+            throw std::runtime_error("Connection pool must hold at least one connection");
+        }
+
+        options.journal_mode = "WAL";
+        this->db_name = db_name;
+        this->options = options;
+        for (size_t i = 0; i < size; ++i) {
+            std::unique_ptr<SQLITE3> db(new SQLITE3(db_name, options));
+            idle.push_back(db.get());
+            connections.push_back(std::move(db));
+        }
+    }
+
+    SQLITE3_POOL(const SQLITE3_POOL &rhs) = delete;
+
+    SQLITE3_POOL &operator=(const SQLITE3_POOL &rhs) = delete;
+
+    /**
+     * Check out a connection, block until one is available
+     * @return connection, returned to the pool when destroyed
+     */
+    CONNECTION acquire() {
+        std::unique_lock<std::mutex> guard(lock);
+        available.wait(guard, [this] { return !idle.empty(); });
+
+        SQLITE3 *db = idle.back();
+        idle.pop_back();
+        return CONNECTION(this, db);
+    }
+
+    /**
+     * Scan a table in parallel, split into rowid ranges run on separate connections
+     *
+     * query is run once per range with its two ? bound to the first and last rowid of the range, e.g.
+     * "SELECT SUM(price) FROM orders WHERE rowid BETWEEN ? AND ?;". Ranges cover [MIN(rowid), MAX(rowid)]
+     * evenly, the first range runs on the calling thread. If SQLITE_ENABLE_SNAPSHOT is defined (CMake option
+     * SQLITEPLUS_ENABLE_SNAPSHOT) all ranges read the same WAL snapshot, otherwise each range reads the data
+     * committed when it starts and consistent is set to false.
+     * @tparam T partial result
+     * @param table table to split
+     * @param query query run on each range
+     * @param scan reads the rows of a range, runs on the thread of the range
+     * @param reduce merges two partial results, called in rowid order on the calling thread
+     * @param result initial value, set to the reduced result of all ranges
+     * @param partitions number of ranges, 0 for one per connection, clamped to the connections
+     * idle when the scan starts so that connections held elsewhere never block it
+     * @param consistent if not null, set to true if all ranges read the same snapshot, false if changes
+     * committed during the scan may be seen by some ranges only
+     * @return 0 upon success, 1 if a range failed
+     * @throw rethrows exceptions thrown by scan or reduce
+     */
+    template<typename T>
+    int parallel_scan(const std::string &table, const std::string &query,
+                      const std::function<T(SQLITE3_CURSOR &)> &scan, const std::function<T(T, T)> &reduce,
+                      T &result, size_t partitions = 0, bool *consistent = nullptr) {
+        if (partitions == 0 || partitions > size()) {
+            partitions = size();
+        }
+
+        // every range holds a connection until all ranges are done, take them all up front,
+        // the first connection holds the read transaction the others share
+        CONNECTION first = acquire();
+        std::vector<CONNECTION> others = acquire_idle(partitions - 1);
+        partitions = others.size() + 1;
+        if (consistent) { // a single range reads a single snapshot
+            *consistent = partitions == 1;
+        }
+
+        std::string quoted = "\"";
+        for (char c : table) {
+            quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+        }
+        auto bounds = first->query("SELECT MIN(rowid), MAX(rowid) FROM " + quoted + "\";");
+        if (!bounds.next()) {
+            return 1;
+        }
+        if (bounds.is_null(0)) { // empty table
+            return 0;
+        }
+        auto min = (uint64_t) bounds.get<int64_t>(0);
+        auto max = (uint64_t) bounds.get<int64_t>(1);
+        bounds.close();
+
+        void *snapshot = nullptr;
+#ifdef SQLITE_ENABLE_SNAPSHOT
+        sqlite3_snapshot *shared = nullptr;
+        if (sqlite3_snapshot_get(const_cast<sqlite3 *>(first->get_db()), "main", &shared) != SQLITE_OK) {
+            return 1;
+        }
+        snapshot = shared;
+        if (consistent) {
+            *consistent = true;
+        }
+#endif
+
+        // split [min, max] evenly, max - min + 1 does not fit in 64 bits when the rowids span the full range
+        uint64_t span = max - min;
+        if (partitions > span) {
+            partitions = (size_t) span + 1;
+        }
+        std::vector<std::pair<int64_t, int64_t>> ranges;
+        uint64_t step = span / partitions, remainder = span % partitions, lo = min;
+        for (size_t i = 0; i < partitions; ++i) {
+            uint64_t hi = lo + step - 1 + (i <= remainder ? 1 : 0);
+            ranges.emplace_back((int64_t) lo, (int64_t) hi);
+            lo = hi + 1;
+        }
+
+        // run every range but the first on its own thread and connection
+        std::vector<std::future<std::pair<bool, T>>> partials;
+        for (size_t i = 1; i < ranges.size(); ++i) {
+            auto range = ranges[i];
+            SQLITE3 *db = &*others[i - 1];
+            partials.push_back(std::async(std::launch::async, [db, range, &query, &scan, snapshot] {
+                return scan_range(*db, query, range, scan, snapshot);
+            }));
+        }
+
+        // wait for every thread before the first connection ends the shared read transaction
+        std::pair<bool, T> own;
+        std::exception_ptr error;
+        try {
+            own = scan_range(*first, query, ranges[0], scan, nullptr);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        std::vector<std::pair<bool, T>> collected;
+        for (auto &partial : partials) {
+            try {
+                collected.push_back(partial.get());
+            } catch (...) {
+                error = error ? error : std::current_exception();
+            }
+        }
+#ifdef SQLITE_ENABLE_SNAPSHOT
+        sqlite3_snapshot_free(shared);
+#endif
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        // merge in rowid order
+        bool failed = !own.first;
+        result = reduce(std::move(result), std::move(own.second));
+        for (auto &partial : collected) {
+            failed = failed || !partial.first;
+            result = reduce(std::move(result), std::move(partial.second));
+        }
+        return failed ? 1 : 0;
+    }
+
+    /**
+     * Get the number of connections in the pool
+     * @return number of connections
+     */
+    size_t size() const {
+        return connections.size();
+    }
+
+    /**
+     * Get the number of connections not checked out
+     * @return number of idle connections
+     */
+    size_t idle_count() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return idle.size();
+    }
+
+private:
+    /**
+     * Check out up to count connections without waiting
+     * @param count number of connections wanted
+     * @return the connections idle right now, at most count
+     */
+    std::vector<CONNECTION> acquire_idle(size_t count) {
+        std::vector<CONNECTION> taken;
+        std::lock_guard<std::mutex> guard(lock);
+        while (taken.size() < count && !idle.empty()) {
+            taken.emplace_back(this, idle.back());
+            idle.pop_back();
+        }
+        return taken;
+    }
+
+    /**
+     * Run query over one rowid range
+     * @return success and partial result
+     */
+    template<typename T>
+    static std::pair<bool, T> scan_range(SQLITE3 &db, const std::string &query, std::pair<int64_t, int64_t> range,
+                                         const std::function<T(SQLITE3_CURSOR &)> &scan, void *snapshot) {
+#ifdef SQLITE_ENABLE_SNAPSHOT
+        // the transaction of a returned connection has not read anything yet
+        if (snapshot && sqlite3_snapshot_open(const_cast<sqlite3 *>(db.get_db()), "main",
+                                              reinterpret_cast<sqlite3_snapshot *>(snapshot)) != SQLITE_OK) {
+            return std::make_pair(false, T());
+        }
+#else
+        (void) snapshot;
+#endif
+
+        SQLITE3_QUERY bounded(query);
+        bounded.add_binding(range.first, range.second);
+        auto cursor = db.query(bounded);
+        T partial = scan(cursor);
+        cursor.close();
+        return std::make_pair(cursor.error_no == NO_ERROR, std::move(partial));
+    }
+
+    /**
+     * Put a connection back, its transaction is committed so the next user reads a fresh snapshot
+     *
+     * A transaction that cannot be committed is rolled back, its changes must not reach the next user.
+     * If that fails too the connection is opened again
+     * @param db connection
+     */
+    void release(SQLITE3 *db) {
+        if (db->commit() && db->rollback()) {
+            db->open(db_name, options);
+        }
+        db->error_no = NO_ERROR;
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            idle.push_back(db);
+        }
+        available.notify_one();
+    }
+
+    std::string db_name;
+    SQLITE3_OPTIONS options;
+    std::vector<std::unique_ptr<SQLITE3>> connections;
+    std::vector<SQLITE3 *> idle;
+
+    mutable std::mutex lock;
+    std::condition_variable available;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_POOL_HPP
@@ -0,0 +1,301 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_PROFILER_HPP
+#define SQLITEPLUS_SQLITE3_PROFILER_HPP
+
+#include <sqlite3.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Aggregated statistics of one statement
+ */
+struct SQLITE3_PROFILE_STATS {
+    uint64_t count{}; // number of executions
+    uint64_t total_ns{}; // total run time
+    uint64_t max_ns{}; // slowest execution
+    uint64_t vm_steps{}; // virtual machine operations
+    uint64_t fullscan_steps{}; // steps of full table scans
+    uint64_t sorts{}; // sort operations
+    uint64_t autoindexes{}; // rows inserted into automatic indexes
+
+    /**
+     * Get the latency below which fraction of the executions completed
+     * @param fraction between 0 and 1, e.g. 0.99 for p99
+     * @return latency in nanoseconds, accurate to 1/8 of its power of two
+     */
+    uint64_t percentile(double fraction) const {
+        if (count == 0) {
+            return 0;
+        }
+
+        uint64_t rank = (uint64_t) (fraction * (double) count);
+        if (rank >= count) {
+            rank = count - 1;
+        }
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < histogram.size(); ++i) {
+            seen += histogram[i];
+            if (seen > rank) {
+                return bucket_upper_bound(i) < max_ns ? bucket_upper_bound(i) : max_ns;
+            }
+        }
+        return max_ns;
+    }
+
+    /**
+     * \private
+     * Record one execution
+     */
+    void record(uint64_t ns) {
+        if (histogram.empty()) {
+            histogram.resize(BUCKETS);
+        }
+
+        count += 1;
+        total_ns += ns;
+        max_ns = ns > max_ns ? ns : max_ns;
+        histogram[bucket_of(ns)] += 1;
+    }
+
+private:
+    // 16 exact buckets, then 8 buckets per power of two
+    static const size_t BUCKETS = 16 + 60 * 8;
+
+    static size_t bucket_of(uint64_t ns) {
+        if (ns < 16) {
+            return (size_t) ns;
+        }
+
+        size_t exponent = 63;
+        while (!(ns >> exponent)) {
+            exponent -= 1;
+        }
+        return 16 + (exponent - 4) * 8 + (size_t) ((ns >> (exponent - 3)) & 7);
+    }
+
+    static uint64_t bucket_upper_bound(size_t bucket) {
+        if (bucket < 16) {
+            return bucket;
+        }
+
+        size_t exponent = (bucket - 16) / 8 + 4;
+        uint64_t sub = (bucket - 16) % 8;
+        return ((8 + sub + 1) << (exponent - 3)) - 1;
+    }
+
+    std::vector<uint64_t> histogram;
+};
+
+/**
+ * Per statement profiler fed by sqlite3_trace_v2(SQLITE_TRACE_PROFILE)
+ *
+ * Statements are grouped by their SQL text, which is the query template for
+ * statements run through SQLITE3_QUERY.
+ */
+class SQLITE3_PROFILER {
+public:
+    /**
+     * Slow query callback
+     * @param sql SQL text of the statement
+     * @param expanded_sql SQL text with the bound values
+     * @param ns run time in nanoseconds
+     */
+    typedef std::function<void(const std::string &sql, const std::string &expanded_sql, uint64_t ns)> SLOW_QUERY_CALLBACK;
+
+    /**
+     * Attach the profiler to a connection, or detach it
+     * @param db connection
+     * @param enable true to start collecting statistics
+     * @return 0 upon success, 1 upon failure
+     */
+    int attach(sqlite3 *db, bool enable) {
+        int rc = enable ? sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE, &SQLITE3_PROFILER::trace, this)
+                        : sqlite3_trace_v2(db, 0, nullptr, nullptr);
+        if (rc != SQLITE_OK) {
+            return 1;
+        }
+
+        enabled = enable;
+        return 0;
+    }
+
+    /**
+     * Check if the profiler is collecting statistics
+     * @return true if attached
+     */
+    bool is_enabled() const {
+        return enabled;
+    }
+
+    /**
+     * Set the callback run for every statement slower than threshold, it runs on the querying thread
+     * @param threshold minimum run time of a slow statement
+     * @param callback callback, an empty function removes it
+     */
+    void set_slow_query_callback(std::chrono::nanoseconds threshold, SLOW_QUERY_CALLBACK callback) {
+        std::lock_guard<std::mutex> guard(lock);
+        slow_query_threshold = (uint64_t) threshold.count();
+        slow_query_callback = std::move(callback);
+    }
+
+    /**
+     * Get a copy of the statistics of all statements
+     * @return statistics by SQL text
+     */
+    std::map<std::string, SQLITE3_PROFILE_STATS> get_stats() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+
+    /**
+     * Delete all statistics
+     */
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        stats.clear();
+    }
+
+    /**
+     * Dump statistics as a JSON array, one object per statement
+     * @return JSON text
+     */
+    std::string to_json() const {
+        auto copy = get_stats();
+
+        std::string json = "[";
+        for (auto &entry : copy) {
+            const SQLITE3_PROFILE_STATS &s = entry.second;
+            char numbers[512];
+            snprintf(numbers, sizeof(numbers),
+                     "\"count\":%llu,\"total_ns\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,"
+                     "\"vm_steps\":%llu,\"fullscan_steps\":%llu,\"sorts\":%llu,\"autoindexes\":%llu",
+                     (unsigned long long) s.count, (unsigned long long) s.total_ns,
+                     (unsigned long long) s.percentile(0.5), (unsigned long long) s.percentile(0.99),
+                     (unsigned long long) s.max_ns, (unsigned long long) s.vm_steps,
+                     (unsigned long long) s.fullscan_steps, (unsigned long long) s.sorts,
+                     (unsigned long long) s.autoindexes);
+
+            json += json.size() > 1 ? ",{\"sql\":" : "{\"sql\":";
+            json += quote(entry.first);
+            json += ",";
+            json += numbers;
+            json += "}";
+        }
+        return json + "]";
+    }
+
+    /**
+     * \private
+     * sqlite3_trace_v2 callback
+     */
+    static int trace(unsigned type, void *profiler, void *p, void *x) {
+        if (type == SQLITE_TRACE_PROFILE) {
+            reinterpret_cast<SQLITE3_PROFILER *>(profiler)->record(reinterpret_cast<sqlite3_stmt *>(p),
+                                                                   (uint64_t) *reinterpret_cast<sqlite3_int64 *>(x));
+        }
+        return 0;
+    }
+
+private:
+    /**
+     * Record one finished statement
+     */
+    void record(sqlite3_stmt *stmt, uint64_t ns) {
+        const char *sql = sqlite3_sql(stmt);
+        std::string key = sql ? sql : "";
+
+        SLOW_QUERY_CALLBACK callback;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            // counters are reset so cached statements report each run on its own
+            SQLITE3_PROFILE_STATS &s = stats[key];
+            s.record(ns);
+            s.vm_steps += (uint64_t) sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+            s.fullscan_steps += (uint64_t) sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+            s.sorts += (uint64_t) sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+            s.autoindexes += (uint64_t) sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+
+            if (slow_query_callback && ns >= slow_query_threshold) {
+                callback = slow_query_callback;
+            }
+        }
+
+        // run outside of the lock, the callback may read the statistics
+        if (callback) {
+            char *expanded = sqlite3_expanded_sql(stmt);
+            callback(key, expanded ? expanded : key, ns);
+            sqlite3_free(expanded);
+        }
+    }
+
+    /**
+     * Quote and escape a string for JSON
+     */
+    static std::string quote(const std::string &text) {
+        std::string quoted = "\"";
+        for (unsigned char c : text) {
+            switch (c) {
+                case '"':
+                    quoted += "\\\"";
+                    break;
+                case '\\':
+                    quoted += "\\\\";
+                    break;
+                case '\n':
+                    quoted += "\\n";
+                    break;
+                case '\t':
+                    quoted += "\\t";
+                    break;
+                default:
+                    if (c < 0x20) {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        quoted += escaped;
+                    } else {
+                        quoted += (char) c;
+                    }
+            }
+        }
+        return quoted + "\"";
+    }
+
+    std::map<std::string, SQLITE3_PROFILE_STATS> stats;
+    std::atomic<bool> enabled{false};
+
+    uint64_t slow_query_threshold{};
+    SLOW_QUERY_CALLBACK slow_query_callback;
+
+    mutable std::mutex lock;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_PROFILER_HPP
@@ -22,9 +22,44 @@
 #ifndef SQLITEPLUS_SQLITE3_QUERY_HPP
 #define SQLITEPLUS_SQLITE3_QUERY_HPP
 
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <vector>
 
+/**
+ * Typed value bound to a query parameter
+ */
+struct SQLITE3_VALUE {
+    enum TYPE {INTEGER_VALUE, FLOAT_VALUE, TEXT_VALUE, BLOB_VALUE, NULL_VALUE, ZEROBLOB_VALUE};
+
+    SQLITE3_VALUE() = default;
+
+    /**
+     * Constructor
+     * @param type type of value
+     * @param integer value of INTEGER_VALUE, size of ZEROBLOB_VALUE
+     * @param real value of FLOAT_VALUE
+     * @param bytes value of TEXT_VALUE and BLOB_VALUE
+     */
+    SQLITE3_VALUE(TYPE type, int64_t integer, double real, std::string bytes) {
+        this->type = type;
+        this->integer = integer;
+        this->real = real;
+        this->bytes = std::move(bytes);
+    }
+
+    TYPE type{NULL_VALUE};
+    int64_t integer{}; // integer value, or size of a zeroblob
+    double real{};
+    std::string bytes; // text or blob content
+};
+
 class SQLITE3_QUERY {
 public:
     /**
@@ -42,6 +77,7 @@ public:
     SQLITE3_QUERY(const SQLITE3_QUERY &rhs) {
         query_template = rhs.query_template;
         binding = rhs.binding;
+        values = rhs.values;
         bound_query = rhs.bound_query;
     }
 
@@ -57,6 +93,7 @@ public:
         // copy the values
         query_template = rhs.query_template;
         binding = rhs.binding;
+        values = rhs.values;
         bound_query = rhs.bound_query;
         return *this;
     }
@@ -79,6 +116,7 @@ public:
      */
     void add_binding(const std::string &str) {
         binding.push_back(str);
+        values.emplace_back(SQLITE3_VALUE::TEXT_VALUE, 0, 0, str);
     }
 
     /**
@@ -86,7 +124,7 @@ public:
      * @param str
      */
     void add_binding(const char * str) {
-        binding.emplace_back(str);
+        add_binding(std::string(str));
     }
 
     /**
@@ -94,45 +132,113 @@ public:
      * @param str
      */
     void add_binding(char * str) {
-        binding.emplace_back(str);
+        add_binding(std::string(str));
+    }
+
+    /**
+     * Add a new integer to the binding vector
+     * @tparam INTEGER integral type
+     * @param value
+     */
+    template<typename INTEGER>
+    typename std::enable_if<std::is_integral<INTEGER>::value>::type add_binding(INTEGER value) {
+        binding.push_back(std::to_string(value));
+        values.emplace_back(SQLITE3_VALUE::INTEGER_VALUE, (int64_t) value, 0, std::string());
+    }
+
+    /**
+     * Add a new floating point number to the binding vector
+     * @tparam REAL floating point type
+     * @param value
+     */
+    template<typename REAL>
+    typename std::enable_if<std::is_floating_point<REAL>::value>::type add_binding(REAL value) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.17g", (double) value);
+        binding.emplace_back(text);
+        values.emplace_back(SQLITE3_VALUE::FLOAT_VALUE, 0, (double) value, std::string());
     }
 
     /**
-     * Add all new string to the binding vector
-     * @tparam STRING string
-     * @tparam STRINGS string pack
+     * Add a NULL to the binding vector
+     */
+    void add_binding(std::nullptr_t) {
+        binding.emplace_back("NULL");
+        values.emplace_back(SQLITE3_VALUE::NULL_VALUE, 0, 0, std::string());
+    }
+
+    /**
+     * Add a new blob to the binding vector
+     * @param data pointer to blob content
+     * @param size size of blob in bytes
+     */
+    void add_blob_binding(const void *data, size_t size) {
+        std::string bytes(reinterpret_cast<const char *>(data), size);
+        binding.push_back(bytes);
+        values.emplace_back(SQLITE3_VALUE::BLOB_VALUE, 0, 0, std::move(bytes));
+    }
+
+    /**
+     * Add a blob of zeros to the binding vector, written later with SQLITE3_BLOB
+     *
+     * The zeros are not allocated, SQLite only reserves the space. The binding is
+     * an empty string if binding is modified directly.
+     * @param size size of blob in bytes
+     */
+    void add_zeroblob_binding(size_t size) {
+        binding.emplace_back();
+        values.emplace_back(SQLITE3_VALUE::ZEROBLOB_VALUE, (int64_t) size, 0, std::string());
+    }
+
+    /**
+     * Add all new values to the binding vector
+     * @tparam VALUE string, number or nullptr
+     * @tparam VALUES value pack
      * @param b binding
      * @param bs binding pack
      */
-    template<typename STRING, typename ... STRINGS>
-    void add_binding(STRING b, STRINGS ... bs) {
-        // check if arguments provided is string type
-        if (typeid(b) == typeid(std::string) || typeid(b) == typeid(const char *) || typeid(b) == typeid(char *)) {
-            binding.push_back(b);
-            add_binding(bs...);
-        }
+    template<typename VALUE, typename VALUE2, typename ... VALUES>
+    void add_binding(VALUE b, VALUE2 b2, VALUES ... bs) {
+        add_binding(b);
+        add_binding(b2, bs...);
     }
 
     /**
-     * Replace all ? in query_template with corresponding strings in binding
+     * Replace all ? in query_template with corresponding values in binding
+     *
+     * Strings are wrapped in quotes, numbers and NULL are inserted as is, blobs
+     * are written as X'' literals and zeroblobs as zeroblob(size). Infinities are
+     * written as 9e999 and -9e999, NaN as NULL
      * @return constructed query
      * @throw std::out_of_range
      * @return SQLITE3_QUERY
      */
     SQLITE3_QUERY &bind() {
-        int index = 0;
+        // typed values are only usable if binding was not modified directly
+        bool typed = values.size() == binding.size();
+
+        size_t index = 0;
+        size_t start = 0;
         bound_query.clear();
-        for (char &c : query_template) {
-            if (c == '?') {
-                if (index == (int) binding.size()) {
-                    throw std::out_of_range("query_template have more argument than binding provided");
-                }
-                bound_query += "'" + binding.at(index) + "'";
-                index += 1;
+        bound_query.reserve(query_template.size() + 8 * binding.size());
+        for (size_t pos = query_template.find('?'); pos != std::string::npos; pos = query_template.find('?', start)) {
+            if (index == binding.size()) {
+                throw std::out_of_range("query_template have more argument than binding provided");
+            }
+
+            bound_query.append(query_template, start, pos - start);
+            if (typed) {
+                append_literal(values[index]);
             } else {
-                bound_query += c;
+                bound_query += '\'';
+                bound_query += binding[index];
+                bound_query += '\'';
             }
+
+            index += 1;
+            start = pos + 1;
         }
+        bound_query.append(query_template, start, std::string::npos);
         return *this;
     }
 
@@ -142,6 +248,7 @@ public:
      */
     SQLITE3_QUERY &reset_binding() {
         binding.clear();
+        values.clear();
         return *this;
     }
 
@@ -158,6 +265,55 @@ public:
     std::string query_template;
     std::string bound_query;
     std::vector<std::string> binding;
+    std::vector<SQLITE3_VALUE> values; // typed copy of binding, used for native parameter binding
+
+private:
+    /**
+     * Append value to bound_query as a SQL literal
+     * @param value
+     */
+    void append_literal(const SQLITE3_VALUE &value) {
+        static const char hex[] = "0123456789ABCDEF";
+
+        switch (value.type) {
+            case SQLITE3_VALUE::INTEGER_VALUE:
+                bound_query += std::to_string(value.integer);
+                break;
+            case SQLITE3_VALUE::FLOAT_VALUE: {
+                // %g prints inf and nan, which are not SQL, SQLite reads 9e999 as infinity
+                // and binds NaN as NULL
+                if (std::isnan(value.real)) {
+                    bound_query += "NULL";
+                } else if (std::isinf(value.real)) {
+                    bound_query += value.real > 0 ? "9e999" : "-9e999";
+                } else {
+                    char text[32];
+                    snprintf(text, sizeof(text), "%.17g", value.real);
+                    bound_query += text;
+                }
+                break;
+            }
+            case SQLITE3_VALUE::TEXT_VALUE:
+                bound_query += '\'';
+                bound_query += value.bytes;
+                bound_query += '\'';
+                break;
+            case SQLITE3_VALUE::BLOB_VALUE:
+                bound_query += "X'";
+                for (unsigned char c : value.bytes) {
+                    bound_query += hex[c >> 4];
+                    bound_query += hex[c & 0xF];
+                }
+                bound_query += '\'';
+                break;
+            case SQLITE3_VALUE::NULL_VALUE:
+                bound_query += "NULL";
+                break;
+            case SQLITE3_VALUE::ZEROBLOB_VALUE:
+                bound_query += "zeroblob(" + std::to_string(value.integer) + ")";
+                break;
+        }
+    }
 };
 
 
@@ -0,0 +1,628 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_RANGE_TABLE_HPP
+#define SQLITEPLUS_SQLITE3_RANGE_TABLE_HPP
+
+#include <sqlite3.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "SQLITE3_FUNCTION.hpp"
+#include "SQLITE3_ROW_MAPPING.hpp"
+
+/**
+ * \private
+ * Read-only eponymous virtual table over a random access range of structs
+ *
+ * Columns are the members listed by SQLITE3_ROW_MAPPING of the element type, the rowid is the
+ * position in the range. Rows are read in place, the range is fetched again at the start of
+ * every scan. Equality and range constraints on the rowid, and on the column the range is
+ * sorted by, are answered by binary search. Constraints on other columns are checked in C++
+ * before a row reaches the virtual machine. SQLite checks every constraint again, a value the
+ * adapter cannot compare exactly (e.g. text against a number column) is left to SQLite.
+ * @tparam ITERATOR random access iterator
+ */
+template<typename ITERATOR>
+class SQLITE3_RANGE_TABLE {
+public:
+    typedef typename std::iterator_traits<ITERATOR>::value_type ROW;
+
+    /**
+     * Returns the current begin and end of the range
+     */
+    typedef std::function<std::pair<ITERATOR, ITERATOR>()> RANGE;
+
+    /**
+     * Register the table as a module of the same name, an existing table of that name is replaced
+     * @param db database connection
+     * @param name name of table
+     * @param range source of the rows
+     * @param columns column names, one per member of the row mapping
+     * @param sorted_by column the range is sorted by in ascending order, empty if none
+     * @param err_msg_str set to the reason upon failure
+     * @return 0 upon success, 1 upon failure
+     */
+    static int create(sqlite3 *db, const std::string &name, RANGE range, const std::vector<std::string> &columns,
+                      const std::string &sorted_by, std::string &err_msg_str) {
+        if (!db) {
+            err_msg_str = "No database connected";
+            return 1;
+        }
+        if (columns.size() != COLUMN_COUNT) {
+            err_msg_str = "Table " + name + " has " + std::to_string(columns.size()) +
+                          " columns, row mapping expects " + std::to_string(COLUMN_COUNT);
+            return 1;
+        }
+
+        auto *table = new TABLE{std::move(range), SQLITE3_ROW_MAPPING<ROW>::members(),
+                                make_columns(typename SEQUENCE<COLUMN_COUNT>::type()), "CREATE TABLE x(", -1};
+        for (size_t i = 0; i < columns.size(); i++) {
+            std::string quoted;
+            for (char c : columns[i]) {
+                quoted += c == '"' ? "\"\"" : std::string(1, c);
+            }
+            table->schema += (i ? ", \"" : "\"") + quoted + "\" " + table->columns[i].type;
+            if (!sorted_by.empty() && sqlite3_stricmp(columns[i].c_str(), sorted_by.c_str()) == 0) {
+                table->sorted_column = (int) i;
+            }
+        }
+        table->schema += ")";
+        if (!sorted_by.empty() && table->sorted_column < 0) {
+            err_msg_str = "Table " + name + " has no column " + sorted_by;
+            delete table;
+            return 1;
+        }
+
+        // a NULL module drops the module of the same name
+        sqlite3_create_module_v2(db, name.c_str(), nullptr, nullptr, nullptr);
+        // the destructor also runs if registration fails
+        if (sqlite3_create_module_v2(db, name.c_str(), &module(), table, &destroy) != SQLITE_OK) {
+            err_msg_str = sqlite3_errmsg(db);
+            return 1;
+        }
+        return 0;
+    }
+
+private:
+    typedef decltype(SQLITE3_ROW_MAPPING<ROW>::members()) MEMBERS;
+
+    static const size_t COLUMN_COUNT = std::tuple_size<MEMBERS>::value;
+
+    template<size_t... I>
+    struct INDICES {
+    };
+
+    template<size_t N, size_t... I>
+    struct SEQUENCE : SEQUENCE<N - 1, N - 1, I...> {
+    };
+
+    template<size_t... I>
+    struct SEQUENCE<0, I...> {
+        typedef INDICES<I...> type;
+    };
+
+    struct TABLE;
+
+    /**
+     * Accessors of one member, selected by column number at run time
+     */
+    struct COLUMN {
+        const char *type;
+        bool text; // collation applies
+        void (*result)(const TABLE &table, const ROW &row, sqlite3_context *context);
+        bool (*compare)(const TABLE &table, const ROW &row, sqlite3_value *value, int &order);
+    };
+
+    struct TABLE {
+        RANGE range;
+        MEMBERS members;
+        std::vector<COLUMN> columns;
+        std::string schema;
+        int sorted_column;
+    };
+
+    struct VTAB {
+        sqlite3_vtab base; // first member, SQLite only sees the base
+        TABLE *table;
+    };
+
+    /**
+     * Constraint checked in C++ for every row
+     */
+    struct FILTER {
+        int column;
+        int op;
+        sqlite3_value *value;
+    };
+
+    struct CURSOR {
+        sqlite3_vtab_cursor base; // first member, SQLite only sees the base
+        TABLE *table;
+        ITERATOR begin;
+        size_t row;
+        size_t end;
+        std::vector<FILTER> filters;
+
+        ~CURSOR() {
+            clear_filters();
+        }
+
+        void clear_filters() {
+            for (auto &filter : filters) {
+                sqlite3_value_free(filter.value);
+            }
+            filters.clear();
+        }
+    };
+
+    static sqlite3_module &module() {
+        static sqlite3_module instance = make_module();
+        return instance;
+    }
+
+    static sqlite3_module make_module() {
+        sqlite3_module m;
+        memset(&m, 0, sizeof(m));
+        m.iVersion = 1;
+        m.xCreate = nullptr; // eponymous only, no CREATE VIRTUAL TABLE
+        m.xConnect = &connect;
+        m.xBestIndex = &best_index;
+        m.xDisconnect = &disconnect;
+        m.xDestroy = &disconnect;
+        m.xOpen = &open;
+        m.xClose = &close;
+        m.xFilter = &filter;
+        m.xNext = &next;
+        m.xEof = &eof;
+        m.xColumn = &column;
+        m.xRowid = &rowid;
+        return m;
+    }
+
+    static void destroy(void *table) {
+        delete reinterpret_cast<TABLE *>(table);
+    }
+
+    static int connect(sqlite3 *db, void *aux, int, const char *const *, sqlite3_vtab **vtab, char **) {
+        auto *table = reinterpret_cast<TABLE *>(aux);
+        int rc = sqlite3_declare_vtab(db, table->schema.c_str());
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+
+        auto *connected = new(std::nothrow) VTAB();
+        if (!connected) {
+            return SQLITE_NOMEM;
+        }
+        connected->table = table;
+        *vtab = &connected->base;
+        return SQLITE_OK;
+    }
+
+    static int disconnect(sqlite3_vtab *vtab) {
+        delete reinterpret_cast<VTAB *>(vtab);
+        return SQLITE_OK;
+    }
+
+    /**
+     * Use every comparison SQLite offers, the plan is passed to filter as "column,op;" pairs
+     * in the order of the arguments
+     */
+    static int best_index(sqlite3_vtab *vtab, sqlite3_index_info *info) {
+        TABLE &table = *reinterpret_cast<VTAB *>(vtab)->table;
+        try {
+            auto range = table.range();
+            double rows = std::max<double>((double) (range.second - range.first), 1);
+            double search = std::log2(rows) + 1;
+            double scanned = rows;
+            double matched = rows;
+            bool bounded = false;
+            bool unique = false;
+
+            std::string plan;
+            int argc = 0;
+            for (int i = 0; i < info->nConstraint; i++) {
+                const auto &constraint = info->aConstraint[i];
+                int op = constraint.op;
+                if (!constraint.usable || (op != SQLITE_INDEX_CONSTRAINT_EQ && op != SQLITE_INDEX_CONSTRAINT_GT &&
+                                           op != SQLITE_INDEX_CONSTRAINT_GE && op != SQLITE_INDEX_CONSTRAINT_LT &&
+                                           op != SQLITE_INDEX_CONSTRAINT_LE)) {
+                    continue;
+                }
+
+                int col = constraint.iColumn;
+                if (col >= 0 && table.columns[col].text) { // only binary collation is compared in C++
+                    const char *collation = sqlite3_vtab_collation(info, i);
+                    if (collation && sqlite3_stricmp(collation, "BINARY") != 0) {
+                        continue;
+                    }
+                }
+
+                info->aConstraintUsage[i].argvIndex = ++argc;
+                info->aConstraintUsage[i].omit = 0;
+                plan += std::to_string(col) + "," + std::to_string(op) + ";";
+
+                bool searched = col < 0 || col == table.sorted_column;
+                if (op == SQLITE_INDEX_CONSTRAINT_EQ) {
+                    matched = col < 0 ? 1 : matched / 10;
+                    unique = unique || col < 0;
+                } else {
+                    matched /= 3;
+                }
+                if (searched) {
+                    scanned = std::min(scanned, op == SQLITE_INDEX_CONSTRAINT_EQ ? matched : scanned / 3);
+                    bounded = true;
+                }
+            }
+
+            info->idxStr = sqlite3_mprintf("%s", plan.c_str());
+            if (!info->idxStr) {
+                return SQLITE_NOMEM;
+            }
+            info->needToFreeIdxStr = 1;
+            info->estimatedCost = (bounded ? search : 0) + scanned;
+            info->estimatedRows = (sqlite3_int64) std::max(std::min(matched, scanned), 1.0);
+            if (unique) {
+                info->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+            }
+
+            // rows are produced in rowid order, which is also the order of the sorted column
+            if (info->nOrderBy == 1 && !info->aOrderBy[0].desc &&
+                (info->aOrderBy[0].iColumn < 0 || info->aOrderBy[0].iColumn == table.sorted_column)) {
+                info->orderByConsumed = 1;
+            }
+            return SQLITE_OK;
+        } catch (std::bad_alloc &) {
+            return SQLITE_NOMEM;
+        } catch (...) {
+            return SQLITE_ERROR;
+        }
+    }
+
+    static int open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor) {
+        auto *opened = new(std::nothrow) CURSOR();
+        if (!opened) {
+            return SQLITE_NOMEM;
+        }
+        opened->table = reinterpret_cast<VTAB *>(vtab)->table;
+        *cursor = &opened->base;
+        return SQLITE_OK;
+    }
+
+    static int close(sqlite3_vtab_cursor *cursor) {
+        delete reinterpret_cast<CURSOR *>(cursor);
+        return SQLITE_OK;
+    }
+
+    static int filter(sqlite3_vtab_cursor *base, int, const char *plan, int argc, sqlite3_value **argv) {
+        auto &cursor = *reinterpret_cast<CURSOR *>(base);
+        TABLE &table = *cursor.table;
+        try {
+            cursor.clear_filters();
+            auto range = table.range();
+            cursor.begin = range.first;
+            size_t size = (size_t) (range.second - range.first);
+            size_t first = 0;
+            size_t last = size;
+
+            const char *position = plan ? plan : "";
+            for (int i = 0; i < argc && *position; i++) {
+                char *rest;
+                int col = (int) strtol(position, &rest, 10);
+                int op = (int) strtol(rest + 1, &rest, 10);
+                position = rest + 1;
+
+                if (col < 0) {
+                    bound_rowid(argv[i], op, size, first, last);
+                } else if (col == table.sorted_column) {
+                    bound_sorted(cursor, argv[i], op, first, last);
+                } else {
+                    sqlite3_value *value = sqlite3_value_dup(argv[i]);
+                    if (!value) {
+                        return SQLITE_NOMEM;
+                    }
+                    cursor.filters.push_back(FILTER{col, op, value});
+                }
+            }
+
+            cursor.row = first;
+            cursor.end = std::max(first, last);
+            skip_filtered(cursor);
+            return SQLITE_OK;
+        } catch (std::bad_alloc &) {
+            return SQLITE_NOMEM;
+        } catch (...) {
+            return SQLITE_ERROR;
+        }
+    }
+
+    static int next(sqlite3_vtab_cursor *base) {
+        auto &cursor = *reinterpret_cast<CURSOR *>(base);
+        cursor.row++;
+        skip_filtered(cursor);
+        return SQLITE_OK;
+    }
+
+    static int eof(sqlite3_vtab_cursor *base) {
+        auto &cursor = *reinterpret_cast<CURSOR *>(base);
+        return cursor.row >= cursor.end;
+    }
+
+    static int column(sqlite3_vtab_cursor *base, sqlite3_context *context, int col) {
+        auto &cursor = *reinterpret_cast<CURSOR *>(base);
+        const ROW &row = *(cursor.begin + cursor.row);
+        cursor.table->columns[col].result(*cursor.table, row, context);
+        return SQLITE_OK;
+    }
+
+    static int rowid(sqlite3_vtab_cursor *base, sqlite3_int64 *rowid) {
+        *rowid = (sqlite3_int64) reinterpret_cast<CURSOR *>(base)->row;
+        return SQLITE_OK;
+    }
+
+    /**
+     * Move the cursor to the first row, from the current one, passing every filter
+     */
+    static void skip_filtered(CURSOR &cursor) {
+        for (; cursor.row < cursor.end; cursor.row++) {
+            const ROW &row = *(cursor.begin + cursor.row);
+            bool pass = true;
+            for (const auto &f : cursor.filters) {
+                int order;
+                if (cursor.table->columns[f.column].compare(*cursor.table, row, f.value, order) &&
+                    !satisfies(f.op, order)) {
+                    pass = false;
+                    break;
+                }
+            }
+            if (pass) {
+                return;
+            }
+        }
+    }
+
+    static bool satisfies(int op, int order) {
+        switch (op) {
+            case SQLITE_INDEX_CONSTRAINT_EQ:
+                return order == 0;
+            case SQLITE_INDEX_CONSTRAINT_GT:
+                return order > 0;
+            case SQLITE_INDEX_CONSTRAINT_GE:
+                return order >= 0;
+            case SQLITE_INDEX_CONSTRAINT_LT:
+                return order < 0;
+            case SQLITE_INDEX_CONSTRAINT_LE:
+                return order <= 0;
+            default:
+                return true;
+        }
+    }
+
+    /**
+     * Narrow [first, last) to the rowids satisfying a constraint, a value that is not a number is left to SQLite
+     */
+    static void bound_rowid(sqlite3_value *value, int op, size_t size, size_t &first, size_t &last) {
+        int type = sqlite3_value_type(value);
+        if (type != SQLITE_INTEGER && type != SQLITE_FLOAT) {
+            return;
+        }
+
+        long double x = type == SQLITE_INTEGER ? (long double) sqlite3_value_int64(value)
+                                               : (long double) sqlite3_value_double(value);
+        auto clamp = [size](long double position) {
+            return position <= 0 ? (size_t) 0 : position >= (long double) size ? size : (size_t) position;
+        };
+        switch (op) {
+            case SQLITE_INDEX_CONSTRAINT_EQ:
+                if (std::floor(x) != x) {
+                    last = first;
+                    return;
+                }
+                first = std::max(first, clamp(x));
+                last = std::min(last, clamp(x + 1));
+                break;
+            case SQLITE_INDEX_CONSTRAINT_GT:
+                first = std::max(first, clamp(std::floor(x) + 1));
+                break;
+            case SQLITE_INDEX_CONSTRAINT_GE:
+                first = std::max(first, clamp(std::ceil(x)));
+                break;
+            case SQLITE_INDEX_CONSTRAINT_LT:
+                last = std::min(last, clamp(std::ceil(x)));
+                break;
+            case SQLITE_INDEX_CONSTRAINT_LE:
+                last = std::min(last, clamp(std::floor(x) + 1));
+                break;
+            default:
+                break;
+        }
+    }
+
+    /**
+     * Narrow [first, last) by binary search on the sorted column
+     */
+    static void bound_sorted(const CURSOR &cursor, sqlite3_value *value, int op, size_t &first, size_t &last) {
+        const TABLE &table = *cursor.table;
+        const COLUMN &sorted = table.columns[table.sorted_column];
+        if (first >= last) {
+            return;
+        }
+        int order;
+        if (!sorted.compare(table, *(cursor.begin + first), value, order)) {
+            return;
+        }
+
+        auto below = [&](const ROW &row, sqlite3_value *v) {
+            int o;
+            sorted.compare(table, row, v, o);
+            return o < 0;
+        };
+        auto above = [&](sqlite3_value *v, const ROW &row) {
+            int o;
+            sorted.compare(table, row, v, o);
+            return o > 0;
+        };
+        auto lower = [&]() {
+            return (size_t) (std::lower_bound(cursor.begin + first, cursor.begin + last, value, below) - cursor.begin);
+        };
+        auto upper = [&]() {
+            return (size_t) (std::upper_bound(cursor.begin + first, cursor.begin + last, value, above) - cursor.begin);
+        };
+
+        switch (op) {
+            case SQLITE_INDEX_CONSTRAINT_EQ: {
+                size_t begin = lower();
+                last = upper();
+                first = begin;
+                break;
+            }
+            case SQLITE_INDEX_CONSTRAINT_GT:
+                first = upper();
+                break;
+            case SQLITE_INDEX_CONSTRAINT_GE:
+                first = lower();
+                break;
+            case SQLITE_INDEX_CONSTRAINT_LT:
+                last = lower();
+                break;
+            case SQLITE_INDEX_CONSTRAINT_LE:
+                last = upper();
+                break;
+            default:
+                break;
+        }
+    }
+
+    template<size_t... I>
+    static std::vector<COLUMN> make_columns(INDICES<I...>) {
+        return std::vector<COLUMN>{COLUMN{type_name(row_member<I>()), is_text(row_member<I>()),
+                                          &column_result<I>, &column_compare<I>}...};
+    }
+
+    /**
+     * Null pointer of the type of member I
+     */
+    template<size_t I>
+    static typename std::remove_reference<decltype(std::declval<ROW &>().*std::get<I>(std::declval<MEMBERS &>()))>::type *
+    row_member() {
+        return nullptr;
+    }
+
+    template<size_t I>
+    static void column_result(const TABLE &table, const ROW &row, sqlite3_context *context) {
+        SQLITE3_FUNCTION::set_result(context, row.*std::get<I>(table.members));
+    }
+
+    template<size_t I>
+    static bool column_compare(const TABLE &table, const ROW &row, sqlite3_value *value, int &order) {
+        return compare(row.*std::get<I>(table.members), value, order);
+    }
+
+    template<typename V>
+    static const char *type_name(V *) {
+        static_assert(std::is_arithmetic<V>::value, "Row mapping members must be numbers, std::string "
+                                                    "or std::vector<uint8_t>");
+        return std::is_integral<V>::value ? "INTEGER" : "REAL";
+    }
+
+    static const char *type_name(std::string *) {
+        return "TEXT";
+    }
+
+    static const char *type_name(std::vector<uint8_t> *) {
+        return "BLOB";
+    }
+
+    template<typename V>
+    static bool is_text(V *) {
+        return std::is_same<V, std::string>::value;
+    }
+
+    /**
+     * Compare a member to a value the way SQLite does
+     * @param member value of the row
+     * @param value right hand side of the constraint
+     * @param order set to the sign of member - value
+     * @return false if the value is of another storage class, SQLite then decides alone
+     */
+    template<typename V>
+    static typename std::enable_if<std::is_arithmetic<V>::value, bool>::type
+    compare(const V &member, sqlite3_value *value, int &order) {
+        long double rhs;
+        switch (sqlite3_value_type(value)) {
+            case SQLITE_INTEGER:
+                rhs = (long double) sqlite3_value_int64(value);
+                break;
+            case SQLITE_FLOAT:
+                rhs = (long double) sqlite3_value_double(value);
+                break;
+            default:
+                return false;
+        }
+        auto lhs = (long double) member;
+        order = lhs < rhs ? -1 : lhs > rhs ? 1 : 0;
+        return true;
+    }
+
+    static bool compare(const std::string &member, sqlite3_value *value, int &order) {
+        if (sqlite3_value_type(value) != SQLITE_TEXT) {
+            return false;
+        }
+        auto text = reinterpret_cast<const char *>(sqlite3_value_text(value));
+        order = compare_bytes(member.data(), member.size(), text, (size_t) sqlite3_value_bytes(value));
+        return true;
+    }
+
+    static bool compare(const std::vector<uint8_t> &member, sqlite3_value *value, int &order) {
+        if (sqlite3_value_type(value) != SQLITE_BLOB) {
+            return false;
+        }
+        auto bytes = sqlite3_value_blob(value);
+        order = compare_bytes(member.data(), member.size(), bytes, (size_t) sqlite3_value_bytes(value));
+        return true;
+    }
+
+    /**
+     * memcmp, then the shorter first, as the BINARY collation
+     */
+    static int compare_bytes(const void *lhs, size_t lhs_size, const void *rhs, size_t rhs_size) {
+        size_t common = std::min(lhs_size, rhs_size);
+        int order = common ? memcmp(lhs, rhs, common) : 0;
+        if (order == 0) {
+            order = lhs_size < rhs_size ? -1 : lhs_size > rhs_size ? 1 : 0;
+        }
+        return order < 0 ? -1 : order > 0 ? 1 : 0;
+    }
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_RANGE_TABLE_HPP
@@ -0,0 +1,258 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_RESULT_HPP
+#define SQLITEPLUS_SQLITE3_RESULT_HPP
+
+#include <sqlite3.h>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * \private
+ */
+typedef std::vector<std::string> SQLITE_ROW_VECTOR;
+
+/**
+ * Query result stored row by row as text, NULL is stored as "NULL"
+ *
+ * The text of all cells is kept in a single arena, one allocation grows with the
+ * result instead of one string per cell and one vector per row. The
+ * std::vector<SQLITE_ROW_VECTOR> returned by get_rows is only built when asked for.
+ *
+ * A result is filled once by the query that produced it and never modified
+ * after it was published, so it can be shared between threads without locking.
+ */
+class SQLITE3_RESULT {
+public:
+    SQLITE3_RESULT() = default;
+
+    SQLITE3_RESULT(const SQLITE3_RESULT &) = delete;
+
+    SQLITE3_RESULT &operator=(const SQLITE3_RESULT &) = delete;
+
+    /**
+     * Get the number of rows
+     * @return number of rows
+     */
+    size_t row_count() const {
+        return rows_appended;
+    }
+
+    /**
+     * Get the number of columns
+     * @return number of columns of the first statement that returned a row, 0 if no row was returned
+     */
+    size_t column_count() const {
+        return column_names.size();
+    }
+
+    /**
+     * Get the number of columns of a row, which differs from column_count() for rows returned
+     * by a later statement of the same query
+     * @param row row index
+     * @return number of columns
+     * @throw std::out_of_range
+     */
+    size_t column_count(size_t row) const {
+        if (row >= row_count()) {
+            throw std::out_of_range("SQLITE3_RESULT: row out of range");
+        }
+        return row_end(row) - row_starts[row];
+    }
+
+    /**
+     * Get a value
+     * @param row row index
+     * @param col column index
+     * @return value as text
+     * @throw std::out_of_range
+     */
+    std::string get(size_t row, size_t col) const {
+        size_t length;
+        const char *text = get_text(row, col, length);
+        return std::string(text, length);
+    }
+
+    /**
+     * Get a value without copying it
+     * @param row row index
+     * @param col column index
+     * @param length set to the length of the value in bytes
+     * @return pointer to the value, null terminated and valid as long as the result
+     * @throw std::out_of_range
+     */
+    const char *get_text(size_t row, size_t col, size_t &length) const {
+        if (row >= row_count() || col >= row_end(row) - row_starts[row]) {
+            throw std::out_of_range("SQLITE3_RESULT: cell out of range");
+        }
+
+        size_t cell = row_starts[row] + col;
+        length = cell_end(cell) - offsets[cell];
+        return arena.data() + offsets[cell];
+    }
+
+    /**
+     * Get the rows
+     *
+     * The rows are copied out of the arena on the first call, prefer get_text
+     * to read large results
+     * @return rows
+     */
+    const std::vector<SQLITE_ROW_VECTOR> &get_rows() const {
+        std::lock_guard<std::mutex> guard(rows_lock);
+        if (!rows) {
+            std::unique_ptr<std::vector<SQLITE_ROW_VECTOR>> built(new std::vector<SQLITE_ROW_VECTOR>());
+            built->reserve(row_count());
+            for (size_t row = 0; row < row_count(); ++row) {
+                SQLITE_ROW_VECTOR values;
+                size_t columns = column_count(row);
+                values.reserve(columns);
+                for (size_t col = 0; col < columns; ++col) {
+                    values.push_back(get(row, col));
+                }
+                built->push_back(std::move(values));
+            }
+            rows = std::move(built);
+        }
+        return *rows;
+    }
+
+    /**
+     * Get the column names
+     * @return column names, empty if no row was returned
+     */
+    const SQLITE_ROW_VECTOR &get_column_names() const {
+        return column_names;
+    }
+
+    /**
+     * Get the memory held by the result, including unused capacity
+     * @return size in bytes
+     */
+    size_t capacity_bytes() const {
+        size_t bytes = sizeof(*this) + arena.capacity() +
+                       (offsets.capacity() + row_starts.capacity()) * sizeof(size_t);
+        for (auto &name : column_names) {
+            bytes += sizeof(name) + name.capacity();
+        }
+        std::lock_guard<std::mutex> guard(rows_lock);
+        if (rows) {
+            for (auto &row : *rows) {
+                bytes += sizeof(row);
+                for (auto &value : row) {
+                    bytes += sizeof(value) + value.capacity();
+                }
+            }
+        }
+        return bytes;
+    }
+
+    /**
+     * \private
+     * Empty the result so it can be filled again, the arena keeps its capacity
+     * @param max_capacity capacity in bytes above which the arena is released
+     */
+    void reset(size_t max_capacity) {
+        // only sizes are reset, cells hold no objects to destroy
+        arena.clear();
+        offsets.clear();
+        row_starts.clear();
+        column_names.clear();
+        rows_appended = 0;
+        rows.reset();
+
+        if (arena.capacity() + (offsets.capacity() + row_starts.capacity()) * sizeof(size_t) > max_capacity) {
+            std::string().swap(arena);
+            std::vector<size_t>().swap(offsets);
+            std::vector<size_t>().swap(row_starts);
+        }
+    }
+
+    /**
+     * \private
+     * Append the current row of a statement
+     * @param stmt statement positioned on a row
+     */
+    void append_row(sqlite3_stmt *stmt) {
+        int argc = sqlite3_column_count(stmt);
+
+        // record column name if needed
+        if (column_names.empty()) {
+            for (int i = 0; i < argc; ++i) {
+                const char *name = sqlite3_column_name(stmt, i);
+                column_names.push_back(std::string(name ? name : "NULL"));
+            }
+        }
+
+        // get result, a later statement of the query may return a different number of columns
+        row_starts.push_back(offsets.size());
+        for (int i = 0; i < argc; ++i) {
+            if (sqlite3_column_type(stmt, i) == SQLITE_NULL) {
+                append_cell("NULL", 4);
+            } else {
+                auto text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, i));
+                append_cell(text, (size_t) sqlite3_column_bytes(stmt, i));
+            }
+        }
+        rows_appended += 1;
+    }
+
+private:
+    /**
+     * Copy one value into the arena, followed by a null terminator
+     */
+    void append_cell(const char *text, size_t length) {
+        offsets.push_back(arena.size());
+        arena.append(text ? text : "", text ? length : 0);
+        arena.push_back('\0');
+    }
+
+    /**
+     * End of a row, one past its last cell in offsets
+     */
+    size_t row_end(size_t row) const {
+        return row + 1 < row_starts.size() ? row_starts[row + 1] : offsets.size();
+    }
+
+    /**
+     * End of a cell, before its null terminator
+     */
+    size_t cell_end(size_t cell) const {
+        return (cell + 1 < offsets.size() ? offsets[cell + 1] : arena.size()) - 1;
+    }
+
+    SQLITE_ROW_VECTOR column_names;
+    std::string arena; // text of all cells, each followed by '\0'
+    std::vector<size_t> offsets; // start of each cell in arena, row by row
+    std::vector<size_t> row_starts; // first cell of each row in offsets
+    size_t rows_appended{};
+
+    // rows copied out of the arena by get_rows
+    mutable std::unique_ptr<std::vector<SQLITE_ROW_VECTOR>> rows;
+    mutable std::mutex rows_lock;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_RESULT_HPP
@@ -0,0 +1,669 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_RESULT_CACHE_HPP
+#define SQLITEPLUS_SQLITE3_RESULT_CACHE_HPP
+
+#include <sqlite3.h>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "SQLITE3_COLUMNAR_RESULT.hpp"
+#include "SQLITE3_QUERY.hpp"
+#include "SQLITE3_RESULT.hpp"
+
+/**
+ * Cache of query results, invalidated per table when the tables a result was read from change
+ *
+ * Only single read-only statements are cached. The tables read and written by a statement are found
+ * once per SQL text with an authorizer. Row changes are reported by the update hook, changes of a
+ * transaction are invalidated again when it is rolled back, and changes committed by other
+ * connections are detected with PRAGMA data_version. User defined functions are assumed to be
+ * deterministic, unless added through SQLITE3 without SQLITE_DETERMINISTIC.
+ */
+class SQLITE3_RESULT_CACHE {
+public:
+    /**
+     * Tables a statement reads and writes
+     */
+    struct ANALYSIS {
+        bool cacheable{}; // single read-only statement returning rows
+        bool schema_change{}; // creates, drops or alters something, or could not be analyzed
+        bool rollback{}; // rolls back to a savepoint
+        std::set<std::string> reads;
+        std::set<std::string> writes;
+    };
+
+    /**
+     * Cached result
+     */
+    struct ENTRY {
+        std::shared_ptr<const SQLITE3_RESULT> rows;
+        std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> columns;
+    };
+
+    /**
+     * Set the memory budget, 0 disables the cache
+     * @param bytes approximate number of bytes the cached results may use
+     */
+    void set_budget(size_t bytes) {
+        std::lock_guard<std::mutex> guard(lock);
+        budget = bytes;
+        enabled = bytes > 0;
+        evict();
+    }
+
+    /**
+     * Check if the cache is enabled
+     * @return true if the budget is not 0
+     */
+    bool is_enabled() const {
+        return enabled;
+    }
+
+    /**
+     * Get the memory budget
+     * @return budget in bytes, 0 if disabled
+     */
+    size_t get_budget() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return budget;
+    }
+
+    /**
+     * Get the approximate memory used by cached results
+     * @return bytes
+     */
+    size_t get_size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return size;
+    }
+
+    /**
+     * Get the number of cached results
+     * @return number of results
+     */
+    size_t get_count() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return entries.size();
+    }
+
+    /**
+     * Get the number of queries answered from the cache
+     * @return hits
+     */
+    uint64_t get_hits() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return hits;
+    }
+
+    /**
+     * Get the number of cacheable queries that had to run
+     * @return misses
+     */
+    uint64_t get_misses() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return misses;
+    }
+
+    /**
+     * Get the number of results dropped because a table they were read from changed
+     * @return invalidations
+     */
+    uint64_t get_invalidations() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return invalidations;
+    }
+
+    /**
+     * Drop every cached result and analysis
+     */
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        drop_all();
+        analyses.clear();
+    }
+
+    /**
+     * \private
+     * Install the authorizer and hooks on a connection
+     * @param db connection
+     */
+    void attach(sqlite3 *db) {
+        sqlite3_set_authorizer(db, &authorize, this);
+        sqlite3_update_hook(db, &on_update, this);
+        sqlite3_commit_hook(db, &on_commit, this);
+        sqlite3_rollback_hook(db, &on_rollback, this);
+    }
+
+    /**
+     * \private
+     * Remove the authorizer and hooks from a connection
+     * @param db connection
+     */
+    static void detach(sqlite3 *db) {
+        sqlite3_set_authorizer(db, nullptr, nullptr);
+        sqlite3_update_hook(db, nullptr, nullptr);
+        sqlite3_commit_hook(db, nullptr, nullptr);
+        sqlite3_rollback_hook(db, nullptr, nullptr);
+    }
+
+    /**
+     * \private
+     * Build the cache key of a query
+     */
+    static std::string key_of(const SQLITE3_QUERY &query, char mode) {
+        std::string key(1, mode);
+        key += query.query_template;
+        key += '\0';
+
+        // length prefixed values, text and blobs may contain anything
+        if (query.values.size() == query.binding.size()) {
+            for (auto &value : query.values) {
+                key += (char) ('0' + value.type);
+                switch (value.type) {
+                    case SQLITE3_VALUE::INTEGER_VALUE:
+                    case SQLITE3_VALUE::ZEROBLOB_VALUE:
+                        key.append(reinterpret_cast<const char *>(&value.integer), sizeof(value.integer));
+                        break;
+                    case SQLITE3_VALUE::FLOAT_VALUE:
+                        key.append(reinterpret_cast<const char *>(&value.real), sizeof(value.real));
+                        break;
+                    case SQLITE3_VALUE::NULL_VALUE:
+                        break;
+                    default:
+                        key += std::to_string(value.bytes.size()) + ':';
+                        key += value.bytes;
+                        break;
+                }
+            }
+        } else {
+            for (auto &text : query.binding) {
+                key += std::to_string(text.size()) + ':';
+                key += text;
+            }
+        }
+        return key;
+    }
+
+    /**
+     * \private
+     * Build the cache key of SQL text
+     */
+    static std::string key_of(const std::string &sql, char mode) {
+        return std::string(1, mode) + sql;
+    }
+
+    /**
+     * \private
+     * Find a cached result
+     * @param key
+     * @param data_version PRAGMA data_version of the connection, a change drops everything
+     * @param entry set to the result upon a hit
+     * @return true upon a hit
+     */
+    bool lookup(const std::string &key, int64_t data_version, ENTRY &entry) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        // another connection committed, possibly a schema change
+        if (data_version != last_data_version) {
+            last_data_version = data_version;
+            drop_all();
+            analyses.clear();
+        }
+
+        auto found = entries.find(key);
+        if (found == entries.end()) {
+            misses += 1;
+            return false;
+        }
+
+        lru.splice(lru.begin(), lru, found->second.position);
+        entry = found->second.entry;
+        hits += 1;
+        return true;
+    }
+
+    /**
+     * \private
+     * Analyze SQL once
+     * @param db connection the cache is attached to
+     * @param sql one or more statements
+     * @return analysis
+     */
+    std::shared_ptr<const ANALYSIS> analyze(sqlite3 *db, const std::string &sql) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = analyses.find(sql);
+            if (found != analyses.end()) {
+                return found->second;
+            }
+        }
+
+        // the authorizer reports every table the statements and their triggers touch, statements
+        // prepared by other threads meanwhile must not be reported
+        auto analysis = std::make_shared<ANALYSIS>();
+        analysis->cacheable = true;
+        int statements = 0;
+        sqlite3_mutex_enter(sqlite3_db_mutex(db));
+        const char *tail = sql.c_str();
+        while (tail && *tail) {
+            sqlite3_stmt *stmt = nullptr;
+            analyzing = analysis.get();
+            int rc = sqlite3_prepare_v2(db, tail, -1, &stmt, &tail);
+            analyzing = nullptr;
+            if (rc != SQLITE_OK) { // unknown statements may change anything
+                analysis->cacheable = false;
+                analysis->schema_change = true;
+                break;
+            }
+            if (!stmt) { // whitespace or comment
+                continue;
+            }
+
+            statements += 1;
+            if (!sqlite3_stmt_readonly(stmt) || sqlite3_column_count(stmt) == 0) {
+                analysis->cacheable = false;
+            }
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_mutex_leave(sqlite3_db_mutex(db));
+        if (statements != 1) {
+            analysis->cacheable = false;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (analyses.size() >= MAX_ANALYSES) {
+            analyses.clear();
+        }
+        analyses[sql] = analysis;
+        return analysis;
+    }
+
+    /**
+     * \private
+     * Cache the result of a query
+     * @param key
+     * @param analysis analysis of the query
+     * @param entry result
+     */
+    void store(const std::string &key, const ANALYSIS &analysis, const ENTRY &entry) {
+        size_t bytes = key.size() + memory_usage(entry);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (bytes > budget) {
+            return;
+        }
+        erase(key);
+
+        lru.push_front(key);
+        auto &stored = entries[key];
+        stored.entry = entry;
+        stored.tables = analysis.reads;
+        stored.bytes = bytes;
+        stored.position = lru.begin();
+        for (auto &table : analysis.reads) {
+            readers[table].insert(key);
+        }
+
+        size += bytes;
+        evict();
+    }
+
+    /**
+     * \private
+     * Drop the results read from the tables a statement wrote
+     * @param analysis analysis of the statement
+     */
+    void invalidate(const ANALYSIS &analysis) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (analysis.schema_change) {
+            drop_all();
+            analyses.clear();
+            return;
+        }
+        for (auto &table : analysis.writes) {
+            drop_table(table);
+        }
+
+        // results read since a change of the transaction may predate the savepoint
+        if (analysis.rollback) {
+            for (auto &table : written) {
+                drop_table(table);
+            }
+        }
+    }
+
+    /**
+     * \private
+     * Drop the results read from table
+     * @param table
+     */
+    void invalidate(const std::string &table) {
+        std::lock_guard<std::mutex> guard(lock);
+        drop_table(lower_case(table));
+    }
+
+    /**
+     * \private
+     * Record if a user defined function returns the same result for the same arguments,
+     * queries calling a volatile function are not cached
+     * @param function name of function
+     * @param deterministic true if registered with SQLITE_DETERMINISTIC
+     */
+    void set_deterministic(const std::string &function, bool deterministic) {
+        std::string name = lower_case(function);
+
+        // a redefined function may change the results already cached
+        std::lock_guard<std::mutex> guard(lock);
+        if (deterministic) {
+            volatile_user_functions.erase(name);
+        } else {
+            volatile_user_functions.insert(name);
+        }
+        drop_all();
+        analyses.clear();
+    }
+
+    /**
+     * \private
+     * Record a table whose rows live outside of the database, e.g. a virtual table over a
+     * C++ container, queries reading it are not cached
+     * @param table name of table
+     */
+    void set_external_table(const std::string &table) {
+        std::string name = lower_case(table);
+
+        std::lock_guard<std::mutex> guard(lock);
+        external_tables.insert(name);
+        drop_all();
+        analyses.clear();
+    }
+
+    /**
+     * \private
+     * Drop the results read from a table changed outside of the update hook, e.g. by a blob write
+     * @param table
+     */
+    void record_write(const std::string &table) {
+        on_update(this, SQLITE_UPDATE, "main", table.c_str(), 0);
+    }
+
+private:
+    /**
+     * \private
+     */
+    struct STORED {
+        ENTRY entry;
+        std::set<std::string> tables;
+        size_t bytes{};
+        std::list<std::string>::iterator position;
+    };
+
+    /**
+     * Approximate memory used by a result
+     */
+    static size_t memory_usage(const ENTRY &entry) {
+        size_t bytes = sizeof(STORED);
+        if (entry.rows) {
+            bytes += entry.rows->capacity_bytes();
+        }
+        if (entry.columns) {
+            for (size_t i = 0; i < entry.columns->column_count(); ++i) {
+                auto &column = entry.columns->column(i);
+                bytes += sizeof(column) + column.name.size() + column.validity.size() + column.arena.size() +
+                         (column.integers.size() + column.reals.size() + column.offsets.size()) * 8;
+            }
+        }
+        return bytes;
+    }
+
+    /**
+     * Remove a result, lock must be held
+     */
+    void erase(const std::string &key) {
+        auto found = entries.find(key);
+        if (found == entries.end()) {
+            return;
+        }
+
+        for (auto &table : found->second.tables) {
+            auto index = readers.find(table);
+            if (index != readers.end()) {
+                index->second.erase(key);
+                if (index->second.empty()) {
+                    readers.erase(index);
+                }
+            }
+        }
+        size -= found->second.bytes;
+        lru.erase(found->second.position);
+        entries.erase(found);
+    }
+
+    /**
+     * Remove the results read from table, lock must be held
+     */
+    void drop_table(const std::string &table) {
+        auto index = readers.find(table);
+        if (index == readers.end()) {
+            return;
+        }
+
+        std::set<std::string> keys;
+        keys.swap(index->second);
+        for (auto &key : keys) {
+            erase(key);
+            invalidations += 1;
+        }
+        readers.erase(table);
+    }
+
+    /**
+     * Remove every result, lock must be held
+     */
+    void drop_all() {
+        invalidations += entries.size();
+        entries.clear();
+        readers.clear();
+        lru.clear();
+        size = 0;
+    }
+
+    /**
+     * Remove the least recently used results until the cache fits its budget, lock must be held
+     */
+    void evict() {
+        while (size > budget && !lru.empty()) {
+            std::string key = lru.back();
+            erase(key);
+        }
+    }
+
+    /**
+     * Table and function names are case insensitive, they are kept in lower case
+     */
+    static std::string lower_case(std::string name) {
+        for (char &c : name) {
+            c = (char) tolower((unsigned char) c);
+        }
+        return name;
+    }
+
+    /**
+     * sqlite3_set_authorizer callback, collect the tables of the statement being analyzed
+     */
+    static int authorize(void *cache, int action, const char *arg1, const char *arg2, const char *database,
+                         const char *) {
+        auto *self = reinterpret_cast<SQLITE3_RESULT_CACHE *>(cache);
+        ANALYSIS *analysis = self->analyzing.load();
+        if (!analysis) { // not analyzing, e.g. a statement is reprepared
+            return SQLITE_OK;
+        }
+
+        switch (action) {
+            case SQLITE_READ:
+                analysis->reads.insert(lower_case(arg1 ? arg1 : ""));
+                if (self->is_external_table(arg1)) {
+                    analysis->cacheable = false;
+                }
+                // PRAGMA data_version only covers the main database
+                if (database && strcmp(database, "main") != 0 && strcmp(database, "temp") != 0) {
+                    analysis->cacheable = false;
+                }
+                break;
+            case SQLITE_INSERT:
+            case SQLITE_UPDATE:
+            case SQLITE_DELETE:
+                analysis->writes.insert(lower_case(arg1 ? arg1 : ""));
+                break;
+            case SQLITE_FUNCTION:
+                if (!is_deterministic(arg2) || self->is_volatile_user_function(arg2)) {
+                    analysis->cacheable = false;
+                }
+                break;
+            case SQLITE_SELECT:
+            case SQLITE_RECURSIVE:
+                break;
+            case SQLITE_SAVEPOINT:
+                analysis->cacheable = false;
+                if (arg1 && sqlite3_stricmp(arg1, "ROLLBACK") == 0) {
+                    analysis->rollback = true;
+                }
+                break;
+            case SQLITE_PRAGMA:
+            case SQLITE_TRANSACTION:
+                analysis->cacheable = false;
+                break;
+            default: // create, drop, alter, attach, analyze ...
+                analysis->cacheable = false;
+                analysis->schema_change = true;
+                break;
+        }
+        return SQLITE_OK;
+    }
+
+    /**
+     * Check if a built-in function always returns the same result for the same arguments
+     */
+    static bool is_deterministic(const char *function) {
+        static const char *const volatile_functions[] = {
+                "random", "randomblob", "changes", "total_changes", "last_insert_rowid", "date", "time",
+                "datetime", "julianday", "strftime", "unixepoch", "current_date", "current_time",
+                "current_timestamp", "sqlite_offset"};
+        if (!function) {
+            return true;
+        }
+        for (const char *name : volatile_functions) {
+            if (sqlite3_stricmp(function, name) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Check if a user defined function was added without SQLITE_DETERMINISTIC
+     */
+    bool is_volatile_user_function(const char *function) {
+        std::string name = lower_case(function ? function : "");
+
+        std::lock_guard<std::mutex> guard(lock);
+        return volatile_user_functions.count(name) > 0;
+    }
+
+    /**
+     * Check if a table was added with set_external_table
+     */
+    bool is_external_table(const char *table) {
+        std::string name = lower_case(table ? table : "");
+
+        std::lock_guard<std::mutex> guard(lock);
+        return external_tables.count(name) > 0;
+    }
+
+    /**
+     * sqlite3_update_hook callback, a row of table changed
+     */
+    static void on_update(void *cache, int, const char *, const char *table, sqlite3_int64) {
+        auto *self = reinterpret_cast<SQLITE3_RESULT_CACHE *>(cache);
+        std::string name = lower_case(table);
+        std::lock_guard<std::mutex> guard(self->lock);
+        self->drop_table(name);
+        self->written.insert(name);
+    }
+
+    /**
+     * sqlite3_commit_hook callback, changes of the transaction are final
+     */
+    static int on_commit(void *cache) {
+        auto *self = reinterpret_cast<SQLITE3_RESULT_CACHE *>(cache);
+        std::lock_guard<std::mutex> guard(self->lock);
+        self->written.clear();
+        return 0;
+    }
+
+    /**
+     * sqlite3_rollback_hook callback, results read after a change of the transaction are wrong now
+     */
+    static void on_rollback(void *cache) {
+        auto *self = reinterpret_cast<SQLITE3_RESULT_CACHE *>(cache);
+        std::lock_guard<std::mutex> guard(self->lock);
+        for (auto &table : self->written) {
+            self->drop_table(table);
+        }
+        self->written.clear();
+    }
+
+    // number of analyzed SQL texts kept
+    static const size_t MAX_ANALYSES = 4096;
+
+    size_t budget{};
+    std::atomic<bool> enabled{false};
+    size_t size{};
+    std::list<std::string> lru; // most recently used first
+    std::unordered_map<std::string, STORED> entries;
+    std::map<std::string, std::set<std::string>> readers; // lower case table -> keys of the results read from it
+    std::set<std::string> written; // lower case tables changed by the current transaction
+    std::set<std::string> volatile_user_functions; // lower case names
+    std::set<std::string> external_tables; // lower case names
+    std::unordered_map<std::string, std::shared_ptr<const ANALYSIS>> analyses;
+    std::atomic<ANALYSIS *> analyzing{nullptr};
+    int64_t last_data_version{-1};
+
+    uint64_t hits{};
+    uint64_t misses{};
+    uint64_t invalidations{};
+
+    mutable std::mutex lock;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_RESULT_CACHE_HPP
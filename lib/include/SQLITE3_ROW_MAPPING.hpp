@@ -0,0 +1,198 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_ROW_MAPPING_HPP
+#define SQLITEPLUS_SQLITE3_ROW_MAPPING_HPP
+
+#include <sqlite3.h>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Mapping of result columns to the members of T, specialize it for every struct read with query_as
+ *
+ * members() returns a tuple of member pointers, column i of the result is read into member i.
+ * Members can be integral, floating point, std::string or std::vector<uint8_t> (blob).
+ * @code
+ * template<>
+ * struct SQLITE3_ROW_MAPPING<Order> {
+ *     static std::tuple<int64_t Order::*, double Order::*, std::string Order::*> members() {
+ *         return std::make_tuple(&Order::id, &Order::price, &Order::item);
+ *     }
+ * };
+ * @endcode
+ */
+template<typename T>
+struct SQLITE3_ROW_MAPPING;
+
+/**
+ * \private
+ * Reads statement rows into T according to SQLITE3_ROW_MAPPING<T>
+ */
+template<typename T>
+class SQLITE3_ROW_MAPPER {
+public:
+    typedef decltype(SQLITE3_ROW_MAPPING<T>::members()) MEMBERS;
+
+    static const size_t COLUMN_COUNT = std::tuple_size<MEMBERS>::value;
+
+    SQLITE3_ROW_MAPPER() : members(SQLITE3_ROW_MAPPING<T>::members()) {}
+
+    /**
+     * Check the columns of a statement against the mapping, once per statement
+     * @param stmt prepared statement
+     * @param err_msg_str set to the reason upon failure
+     * @return 0 upon success, 1 upon failure
+     */
+    int check(sqlite3_stmt *stmt, std::string &err_msg_str) const {
+        if (sqlite3_column_count(stmt) != (int) COLUMN_COUNT) {
+            err_msg_str = "Query returns " + std::to_string(sqlite3_column_count(stmt)) +
+                          " columns, row mapping expects " + std::to_string(COLUMN_COUNT);
+            return 1;
+        }
+        return check_columns(stmt, err_msg_str, typename SEQUENCE<COLUMN_COUNT>::type());
+    }
+
+    /**
+     * Read the current row of a statement
+     * @param stmt statement positioned on a row
+     * @param row struct to fill
+     */
+    void read(sqlite3_stmt *stmt, T &row) const {
+        read_columns(stmt, row, typename SEQUENCE<COLUMN_COUNT>::type());
+    }
+
+private:
+    template<size_t... I>
+    struct INDICES {
+    };
+
+    template<size_t N, size_t... I>
+    struct SEQUENCE : SEQUENCE<N - 1, N - 1, I...> {
+    };
+
+    template<size_t... I>
+    struct SEQUENCE<0, I...> {
+        typedef INDICES<I...> type;
+    };
+
+    template<size_t... I>
+    int check_columns(sqlite3_stmt *stmt, std::string &err_msg_str, INDICES<I...>) const {
+        bool valid[] = {true, check_column(stmt, (int) I, row_member<I>(), err_msg_str)...};
+        for (bool v : valid) {
+            if (!v) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    template<size_t... I>
+    void read_columns(sqlite3_stmt *stmt, T &row, INDICES<I...>) const {
+        int expand[] = {0, (read_column(stmt, (int) I, row.*std::get<I>(members)), 0)...};
+        (void) expand;
+    }
+
+    /**
+     * Null pointer of the type of member I, used to select check_column
+     */
+    template<size_t I>
+    static typename std::remove_reference<decltype(std::declval<T &>().*std::get<I>(std::declval<MEMBERS &>()))>::type *
+    row_member() {
+        return nullptr;
+    }
+
+    /**
+     * Check if the declared type of a column has text or blob affinity, a column declared without
+     * a type keeps any value as is and does not count
+     */
+    static bool has_text_affinity(sqlite3_stmt *stmt, int col) {
+        const char *declared = sqlite3_column_decltype(stmt, col);
+        if (!declared) { // expression, any value
+            return false;
+        }
+
+        std::string type(declared);
+        for (char &c : type) {
+            c = (char) toupper((unsigned char) c);
+        }
+        if (type.find("INT") != std::string::npos) {
+            return false;
+        }
+        return type.find("CHAR") != std::string::npos || type.find("CLOB") != std::string::npos ||
+               type.find("TEXT") != std::string::npos || type.find("BLOB") != std::string::npos;
+    }
+
+    template<typename V>
+    static bool check_column(sqlite3_stmt *stmt, int col, V *, std::string &err_msg_str) {
+        static_assert(std::is_arithmetic<V>::value, "Row mapping members must be numbers, std::string "
+                                                    "or std::vector<uint8_t>");
+        if (has_text_affinity(stmt, col)) {
+            const char *name = sqlite3_column_name(stmt, col);
+            err_msg_str = std::string("Column ") + (name ? name : "NULL") + " of type " +
+                          sqlite3_column_decltype(stmt, col) + " cannot be read into a number";
+            return false;
+        }
+        return true;
+    }
+
+    static bool check_column(sqlite3_stmt *, int, std::string *, std::string &) {
+        return true;
+    }
+
+    static bool check_column(sqlite3_stmt *, int, std::vector<uint8_t> *, std::string &) {
+        return true;
+    }
+
+    template<typename V>
+    static typename std::enable_if<std::is_integral<V>::value>::type
+    read_column(sqlite3_stmt *stmt, int col, V &value) {
+        value = (V) sqlite3_column_int64(stmt, col);
+    }
+
+    template<typename V>
+    static typename std::enable_if<std::is_floating_point<V>::value>::type
+    read_column(sqlite3_stmt *stmt, int col, V &value) {
+        value = (V) sqlite3_column_double(stmt, col);
+    }
+
+    static void read_column(sqlite3_stmt *stmt, int col, std::string &value) {
+        auto text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, col));
+        if (text) {
+            value.assign(text, (size_t) sqlite3_column_bytes(stmt, col));
+        } else {
+            value.clear();
+        }
+    }
+
+    static void read_column(sqlite3_stmt *stmt, int col, std::vector<uint8_t> &value) {
+        auto bytes = reinterpret_cast<const uint8_t *>(sqlite3_column_blob(stmt, col));
+        value.assign(bytes, bytes + (bytes ? sqlite3_column_bytes(stmt, col) : 0));
+    }
+
+    MEMBERS members;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_ROW_MAPPING_HPP
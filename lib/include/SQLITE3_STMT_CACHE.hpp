@@ -0,0 +1,239 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_STMT_CACHE_HPP
+#define SQLITEPLUS_SQLITE3_STMT_CACHE_HPP
+
+#include <sqlite3.h>
+#include <cctype>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * LRU cache of prepared statements, keyed by SQL text
+ *
+ * Statements are checked out with acquire() and handed back with release().
+ * A checked out statement is owned by the caller until it is released, so the
+ * same SQL can be in use more than once at a time.
+ */
+class SQLITE3_STMT_CACHE {
+public:
+    /**
+     * Constructor
+     * @param capacity maximum number of idle statements kept, 0 disables caching
+     */
+    explicit SQLITE3_STMT_CACHE(size_t capacity = 16) {
+        this->capacity = capacity;
+    }
+
+    SQLITE3_STMT_CACHE(const SQLITE3_STMT_CACHE &rhs) = delete;
+
+    SQLITE3_STMT_CACHE &operator=(const SQLITE3_STMT_CACHE &rhs) = delete;
+
+    /**
+     * Destructor, finalize all idle statements
+     */
+    ~SQLITE3_STMT_CACHE() {
+        clear();
+    }
+
+    /**
+     * Check out a prepared statement for sql, preparing it if it is not cached
+     * @param db database connection
+     * @param sql a single SQL statement
+     * @return prepared statement, nullptr if sql cannot be prepared or holds more than one statement
+     */
+    sqlite3_stmt *acquire(sqlite3 *db, const std::string &sql) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            auto it = index.find(sql);
+            if (it != index.end()) {
+                sqlite3_stmt *stmt = it->second->second;
+                lru.erase(it->second);
+                index.erase(it);
+
+                hits += 1;
+                return stmt;
+            }
+
+            misses += 1;
+        }
+
+        // prepare outside of the lock, this is the expensive part
+        sqlite3_stmt *stmt = nullptr;
+        const char *tail = nullptr;
+        int rc = sqlite3_prepare_v3(db, sql.c_str(), (int) sql.size() + 1, SQLITE_PREPARE_PERSISTENT, &stmt, &tail);
+        if (rc != SQLITE_OK || !stmt) {
+            sqlite3_finalize(stmt);
+            return nullptr;
+        }
+
+        // only a single statement can be cached
+        for (; tail && *tail; ++tail) {
+            if (!std::isspace((unsigned char) *tail)) {
+                sqlite3_finalize(stmt);
+                return nullptr;
+            }
+        }
+
+        return stmt;
+    }
+
+    /**
+     * Hand a statement back to the cache, it will be reset and its bindings cleared
+     * @param sql SQL the statement was acquired with
+     * @param stmt statement returned by acquire
+     */
+    void release(const std::string &sql, sqlite3_stmt *stmt) {
+        if (!stmt) {
+            return;
+        }
+
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+
+        std::vector<sqlite3_stmt *> evicted;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            // keep only one idle copy of each statement
+            if (capacity == 0 || index.count(sql)) {
+                evicted.push_back(stmt);
+            } else {
+                lru.emplace_front(sql, stmt);
+                index[sql] = lru.begin();
+                evict(evicted);
+            }
+        }
+        finalize(evicted);
+    }
+
+    /**
+     * Finalize all idle statements, must be called before the connection is closed
+     */
+    void clear() {
+        std::vector<sqlite3_stmt *> evicted;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            for (auto &entry : lru) {
+                evicted.push_back(entry.second);
+            }
+            lru.clear();
+            index.clear();
+        }
+        finalize(evicted);
+    }
+
+    /**
+     * Set the maximum number of idle statements kept
+     * @param new_capacity capacity, 0 disables caching
+     */
+    void set_capacity(size_t new_capacity) {
+        std::vector<sqlite3_stmt *> evicted;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            capacity = new_capacity;
+            evict(evicted);
+        }
+        finalize(evicted);
+    }
+
+    /**
+     * Get the maximum number of idle statements kept
+     * @return capacity
+     */
+    size_t get_capacity() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return capacity;
+    }
+
+    /**
+     * Get the number of idle statements currently cached
+     * @return number of cached statements
+     */
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return lru.size();
+    }
+
+    /**
+     * Get the number of acquire calls served from the cache
+     * @return cache hits
+     */
+    uint64_t get_hits() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return hits;
+    }
+
+    /**
+     * Get the number of acquire calls that had to prepare a statement
+     * @return cache misses
+     */
+    uint64_t get_misses() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return misses;
+    }
+
+private:
+    /**
+     * Remove least recently used statements until the cache fits its capacity, lock must be held
+     * @param evicted receives the removed statements
+     */
+    void evict(std::vector<sqlite3_stmt *> &evicted) {
+        while (lru.size() > capacity) {
+            evicted.push_back(lru.back().second);
+            index.erase(lru.back().first);
+            lru.pop_back();
+        }
+    }
+
+    /**
+     * Finalize removed statements, outside of the lock since sqlite3_finalize takes the database mutex
+     * which a thread waiting for the lock may hold
+     * @param evicted
+     */
+    static void finalize(const std::vector<sqlite3_stmt *> &evicted) {
+        for (sqlite3_stmt *stmt : evicted) {
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    typedef std::list<std::pair<std::string, sqlite3_stmt *>> LRU_LIST;
+
+    size_t capacity;
+    uint64_t hits{};
+    uint64_t misses{};
+
+    LRU_LIST lru; // most recently used at the front
+    std::unordered_map<std::string, LRU_LIST::iterator> index;
+
+    mutable std::mutex lock;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_STMT_CACHE_HPP
@@ -0,0 +1,245 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef SQLITEPLUS_SQLITE3_WRITER_HPP
+#define SQLITEPLUS_SQLITE3_WRITER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "SQLITE3.hpp"
+
+/**
+ * Background writer committing statements from many threads in batches
+ *
+ * Statements are queued from any thread and run in order on a dedicated
+ * connection. A batch is committed once its statements changed max_batch_size
+ * rows or max_batch_latency has passed since its first statement, whichever
+ * comes first. A statement changing no row counts as one.
+ */
+class SQLITE3_WRITER {
+public:
+    /**
+     * Constructor, open db_name and start the writer thread
+     * @param db_name name of database to open
+     * @param max_batch_size number of changed rows after which a transaction is committed
+     * @param max_batch_latency maximum time a statement waits for its commit
+     * @throw std::runtime_error if the database cannot be opened
+     */
+    explicit SQLITE3_WRITER(const std::string &db_name,
+                            size_t max_batch_size = 5000,
+                            std::chrono::microseconds max_batch_latency = std::chrono::milliseconds(10))
+            : db(db_name) {
+        this->max_batch_size = max_batch_size ? max_batch_size : 1;
+        this->max_batch_latency = max_batch_latency;
+
+        writer = std::thread(&SQLITE3_WRITER::run, this);
+    }
+
+    SQLITE3_WRITER(const SQLITE3_WRITER &rhs) = delete;
+
+    SQLITE3_WRITER &operator=(const SQLITE3_WRITER &rhs) = delete;
+
+    /**
+     * Destructor, commit all queued statements and stop the writer thread
+     */
+    ~SQLITE3_WRITER() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        queued.notify_one();
+        writer.join();
+    }
+
+    /**
+     * Queue a statement
+     * @param query
+     * @return future set to 0 once the statement is committed, 1 if it failed or was rolled back
+     */
+    std::future<int> write(const SQLITE3_QUERY &query) {
+        JOB job;
+        job.query = query;
+        return enqueue(std::move(job));
+    }
+
+    /**
+     * Queue a statement
+     * @param query
+     * @return future set to 0 once the statement is committed, 1 if it failed or was rolled back
+     */
+    std::future<int> write(const std::string &query) {
+        JOB job;
+        job.sql = query;
+        job.plain = true;
+        return enqueue(std::move(job));
+    }
+
+    /**
+     * Get the number of committed batches
+     * @return number of batches
+     */
+    uint64_t get_batch_count() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return batch_count;
+    }
+
+    /**
+     * Get the number of statements processed in committed batches, including failed ones, statements of
+     * batches rolled back after a failed COMMIT are not counted
+     * @return number of statements
+     */
+    uint64_t get_write_count() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return write_count;
+    }
+
+private:
+    /**
+     * \private
+     */
+    struct JOB {
+        SQLITE3_QUERY query;
+        std::string sql;
+        bool plain{};
+        std::promise<int> done;
+    };
+
+    /**
+     * Put job into the queue
+     */
+    std::future<int> enqueue(JOB &&job) {
+        std::future<int> ret = job.done.get_future();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            queue.push_back(std::move(job));
+        }
+        queued.notify_one();
+        return ret;
+    }
+
+    /**
+     * Writer thread
+     */
+    void run() {
+        std::vector<JOB> batch;
+        std::vector<int> status;
+        std::deque<JOB> taken;
+        auto *handle = const_cast<sqlite3 *>(db.get_db());
+
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            queued.wait(guard, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) { // stopping and nothing left
+                return;
+            }
+
+            // fill the batch until it is full or its first statement waited long enough
+            auto deadline = std::chrono::steady_clock::now() + max_batch_latency;
+            size_t rows = 0;
+            while (rows < max_batch_size) {
+                if (queue.empty()) {
+                    if (stopping ||
+                        !queued.wait_until(guard, deadline, [this] { return stopping || !queue.empty(); })) {
+                        break;
+                    }
+                    continue;
+                }
+
+                // run statements without holding the lock
+                size_t count = std::min(queue.size(), max_batch_size - rows);
+                taken.assign(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.begin() + count));
+                queue.erase(queue.begin(), queue.begin() + count);
+                guard.unlock();
+
+                // a statement may change any number of rows, stop as soon as the batch is full
+                size_t run = 0;
+                for (; run < taken.size() && rows < max_batch_size; ++run) {
+                    auto &job = taken[run];
+                    int changes = sqlite3_total_changes(handle);
+                    int rc = job.plain ? db.execute(job.sql) : db.execute(job.query);
+                    if (rc && sqlite3_get_autocommit(handle)) {
+                        // SQLite rolled back the transaction, the earlier statements of the batch are gone
+                        std::fill(status.begin(), status.end(), 1);
+                        db.rollback();
+                    }
+                    rows += (size_t) std::max(sqlite3_total_changes(handle) - changes, 1);
+                    status.push_back(rc);
+                    batch.push_back(std::move(job));
+                }
+
+                // statements not run go back to the front of the queue, in order
+                guard.lock();
+                queue.insert(queue.begin(), std::make_move_iterator(taken.begin() + run),
+                             std::make_move_iterator(taken.end()));
+                taken.clear();
+            }
+            guard.unlock();
+
+            // statements are durable once committed, a failed COMMIT may leave the transaction
+            // open and the next one must not make this batch durable
+            int rc = db.commit();
+            if (rc) {
+                db.rollback();
+            }
+
+            if (!rc) {
+                guard.lock();
+                batch_count += 1;
+                write_count += batch.size();
+                guard.unlock();
+            }
+
+            for (size_t i = 0; i < batch.size(); ++i) {
+                batch[i].done.set_value(rc ? 1 : status[i]);
+            }
+            batch.clear();
+            status.clear();
+
+            guard.lock();
+        }
+    }
+
+    SQLITE3 db;
+    std::thread writer;
+
+    size_t max_batch_size;
+    std::chrono::microseconds max_batch_latency;
+
+    std::deque<JOB> queue;
+    bool stopping{};
+    uint64_t batch_count{};
+    uint64_t write_count{};
+
+    mutable std::mutex lock;
+    std::condition_variable queued;
+};
+
+
+#endif //SQLITEPLUS_SQLITE3_WRITER_HPP
@@ -95,7 +95,7 @@ int main() {
                         int id = sqlite3_value_int(value[0]);
                         std::string result = std::string("Hello" + std::to_string(id));
 
-                        sqlite3_result_text(c, result.c_str(), result.length(), nullptr);
+                        sqlite3_result_text(c, result.c_str(), result.length(), SQLITE_TRANSIENT);
                     });
     db.execute("SELECT PrintHello(id) FROM TEST;");
     db.print_result();
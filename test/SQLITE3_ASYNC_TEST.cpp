@@ -0,0 +1,84 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#include "SQLITE3_ASYNC.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+int main() {
+    std::remove("async_test.db");
+    {
+        SQLITE3_ASYNC async("async_test.db");
+        auto created = async.execute_async("CREATE TABLE test (id int PRIMARY KEY, data text);");
+
+        // pipelined inserts, run in order
+        std::vector<std::future<SQLITE3_ASYNC_RESULT>> inserts;
+        SQLITE3_QUERY insert("INSERT INTO test VALUES (?, ?);");
+        for (int i = 0; i < 100; ++i) {
+            insert.reset_binding().add_binding(i, "data");
+            inserts.push_back(async.execute_async(insert));
+        }
+        assert(created.get().rc == 0);
+        for (auto &result : inserts) {
+            assert(result.get().rc == 0);
+        }
+
+        // failed statements report their error
+        SQLITE3_ASYNC_RESULT failed = async.execute_async(insert).get();
+        assert(failed.rc == 1);
+        assert(failed.error_no == EXECUTION_ERROR);
+        assert(failed.err_msg_str.find("UNIQUE") != std::string::npos);
+        assert(async.execute_async("SELECT 1;").get().err_msg_str.empty());
+
+        // results are returned with the future
+        SQLITE3_QUERY count("SELECT COUNT(*) FROM test WHERE id >= ?;");
+        count.add_binding(50);
+        SQLITE3_ASYNC_RESULT counted = async.execute_async(count).get();
+        assert(counted.rc == 0);
+        assert(counted.rows->get(0, 0) == "50");
+
+        // or passed to a callback
+        std::atomic<int> called(0);
+        std::promise<void> last;
+        for (int i = 0; i < 10; ++i) {
+            async.execute_async("SELECT data FROM test WHERE id = 1;", [&called, &last](SQLITE3_ASYNC_RESULT result) {
+                assert(result.rc == 0 && result.rows->get(0, 0) == "data");
+                if (++called == 10) {
+                    last.set_value();
+                }
+            });
+        }
+        last.get_future().wait();
+        assert(called == 10);
+
+        assert(async.commit_async().get().rc == 0);
+    }
+
+    // committed statements are durable
+    SQLITE3 db("async_test.db");
+    assert(!db.execute("SELECT COUNT(*) FROM test;"));
+    assert(db.copy_result()->at(0).at(0) == "100");
+
+    std::remove("async_test.db");
+    return 0;
+}
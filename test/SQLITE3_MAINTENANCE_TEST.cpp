@@ -0,0 +1,147 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#include "SQLITE3_MAINTENANCE.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <thread>
+
+int main() {
+    std::remove("maintenance_test.db");
+    std::remove("maintenance_test.db-wal");
+    std::remove("maintenance_test.db-shm");
+    {
+        SQLITE3_OPTIONS options;
+        options.journal_mode = "WAL";
+        SQLITE3 db("maintenance_test.db", options);
+        int rc = db.execute("PRAGMA wal_autocheckpoint = 0;") ||
+                 db.execute("CREATE TABLE test (id int PRIMARY KEY, data text);");
+        for (int i = 0; i < 100; ++i) {
+            SQLITE3_QUERY insert("INSERT INTO test VALUES (?, ?);");
+            insert.add_binding(i, std::string(1000, 'x'));
+            rc |= db.execute(insert);
+        }
+        rc |= db.commit();
+        assert(!rc);
+
+        // rounds are run by hand, the thread waits for an hour
+        SQLITE3_MAINTENANCE maintenance(db, std::chrono::hours(1));
+        maintenance.set_idle_time(std::chrono::hours(1));
+        maintenance.set_optimize_interval(std::chrono::milliseconds(0));
+        maintenance.set_vacuum_interval(std::chrono::milliseconds(0));
+
+        // passive checkpoint copies the committed frames
+        rc = maintenance.checkpoint();
+        assert(!rc);
+        auto stats = maintenance.get_stats();
+        assert(stats.checkpoints == 1 && stats.escalations == 0);
+        assert(stats.wal_frames > 0);
+        assert(stats.frames_checkpointed == (uint64_t) stats.wal_frames);
+
+        // a large WAL is restarted
+        maintenance.set_wal_size_limit(1);
+        rc = maintenance.maintain();
+        assert(!rc);
+        stats = maintenance.get_stats();
+        assert(stats.checkpoints == 3 && stats.escalations == 1);
+
+        // escalated checkpoints do not wait for readers of other connections with the busy handler
+        rc = db.set_busy_backoff(std::chrono::milliseconds(1), std::chrono::milliseconds(100),
+                                 std::chrono::seconds(10));
+        assert(!rc);
+        {
+            SQLITE3 reader("maintenance_test.db", options);
+            rc = reader.execute("SELECT COUNT(*) FROM test;") || // snapshot older than the next commit
+                 db.execute("INSERT INTO test VALUES (1000, 'data');") || db.commit();
+            assert(!rc);
+            auto started = std::chrono::steady_clock::now();
+            rc = maintenance.checkpoint(SQLITE_CHECKPOINT_RESTART);
+            assert(rc == 1);
+            assert(std::chrono::steady_clock::now() - started < std::chrono::seconds(5));
+            stats = maintenance.get_stats();
+            assert(stats.busy == 1 && stats.escalations == 1);
+        }
+        rc = db.execute("DELETE FROM test WHERE id = 1000;") || db.commit() ||
+             maintenance.checkpoint(SQLITE_CHECKPOINT_RESTART);
+        assert(!rc);
+        assert(maintenance.get_stats().escalations == 2);
+
+        // the transaction of the connection is left alone, a savepoint that has not read anything yet too
+        maintenance.set_wal_size_limit(0);
+        rc = db.execute("SAVEPOINT kept;");
+        assert(!rc);
+        rc = maintenance.maintain();
+        assert(!rc);
+        rc = db.execute("ROLLBACK TO kept;") || db.execute("RELEASE kept;");
+        assert(!rc);
+        rc = db.execute("SELECT COUNT(*) FROM test;") || maintenance.maintain();
+        assert(!rc);
+        assert(sqlite3_txn_state(const_cast<sqlite3 *>(db.get_db()), nullptr) == SQLITE_TXN_READ);
+        db.commit();
+
+        // an idle WAL is truncated
+        maintenance.set_idle_time(std::chrono::milliseconds(0));
+        rc = maintenance.maintain();
+        assert(!rc);
+        stats = maintenance.get_stats();
+        assert(stats.wal_frames == 0 && stats.escalations == 3);
+
+        // optimize and vacuum, optimize waits until the connection is in autocommit mode
+        maintenance.set_optimize_interval(std::chrono::milliseconds(1));
+        maintenance.set_vacuum_interval(std::chrono::milliseconds(1), 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        rc = maintenance.maintain();
+        assert(!rc);
+        stats = maintenance.get_stats();
+        assert(stats.optimizations == 0 && stats.vacuums == 1 && stats.failures == 0);
+        rc = db.execute("COMMIT;") || maintenance.maintain() || db.execute("BEGIN;");
+        assert(!rc);
+        stats = maintenance.get_stats();
+        assert(stats.optimizations == 1 && stats.failures == 0);
+
+        // the connection still works and keeps its transaction
+        rc = db.execute("INSERT INTO test VALUES (100, 'data');") || db.commit();
+        assert(!rc);
+    }
+
+    // rounds run in the background
+    {
+        SQLITE3_OPTIONS options;
+        options.journal_mode = "WAL";
+        SQLITE3 db("maintenance_test.db", options);
+        SQLITE3_MAINTENANCE maintenance(db, std::chrono::milliseconds(5));
+        int rc = db.execute("PRAGMA wal_autocheckpoint = 0;") ||
+                 db.execute("INSERT INTO test VALUES (101, 'data');") || db.commit();
+        assert(!rc);
+        for (int i = 0; i < 200 && maintenance.get_stats().frames_checkpointed == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        assert(maintenance.get_stats().frames_checkpointed > 0);
+
+        rc = db.execute("SELECT COUNT(*) FROM test;");
+        assert(!rc && db.copy_result()->at(0).at(0) == "102");
+    }
+
+    std::remove("maintenance_test.db");
+    std::remove("maintenance_test.db-wal");
+    std::remove("maintenance_test.db-shm");
+    return 0;
+}
@@ -0,0 +1,177 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#include "SQLITE3_POOL.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <thread>
+
+int main() {
+    std::remove("pool_test.db");
+    SQLITE3_POOL pool("pool_test.db", 4);
+    assert(pool.size() == 4);
+    assert(pool.idle_count() == 4);
+
+    // write through one connection
+    {
+        auto db = pool.acquire();
+        assert(pool.idle_count() == 3);
+        assert(!db->execute("CREATE TABLE test (id int PRIMARY KEY, data text);"));
+        SQLITE3_QUERY insert("INSERT INTO test VALUES (?, ?);");
+        for (int i = 0; i < 100; ++i) {
+            insert.reset_binding().add_binding(i, "data");
+            assert(!db->execute(insert));
+        }
+    } // committed when returned
+    assert(pool.idle_count() == 4);
+
+    // database is in WAL mode
+    {
+        auto db = pool.acquire();
+        assert(!db->execute("PRAGMA journal_mode;"));
+        assert(db->copy_result()->at(0).at(0) == "wal");
+    }
+
+    // read from many threads, more threads than connections
+    std::atomic<int> total(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 8; ++i) {
+        readers.emplace_back([&pool, &total] {
+            for (int j = 0; j < 10; ++j) {
+                auto db = pool.acquire();
+                auto cursor = db->query("SELECT COUNT(*) FROM test;");
+                assert(cursor.next());
+                total += cursor.get<int>(0);
+            }
+        });
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    assert(total == 8 * 10 * 100);
+    assert(pool.idle_count() == 4);
+
+    // moved connections are returned once
+    {
+        auto db = pool.acquire();
+        auto moved = std::move(db);
+        assert(pool.idle_count() == 3);
+        moved.release();
+        assert(pool.idle_count() == 4);
+    }
+
+    // parallel scan by rowid ranges
+    {
+        auto db = pool.acquire();
+        SQLITE3_QUERY insert("INSERT INTO test VALUES (?, ?);");
+        for (int i = 100; i < 10000; ++i) {
+            insert.reset_binding().add_binding(i, "data");
+            assert(!db->execute(insert));
+        }
+    }
+    std::function<int64_t(SQLITE3_CURSOR &)> sum = [](SQLITE3_CURSOR &cursor) {
+        int64_t total = 0;
+        while (cursor.next()) {
+            total += cursor.get<int64_t>(0);
+        }
+        return total;
+    };
+    std::function<int64_t(int64_t, int64_t)> add = [](int64_t a, int64_t b) {
+        return a + b;
+    };
+    int64_t scanned = 0;
+    bool consistent = false;
+    assert(!pool.parallel_scan("test", "SELECT id FROM test WHERE rowid BETWEEN ? AND ?;", sum, add, scanned, 0,
+                               &consistent));
+    assert(scanned == (int64_t) 9999 * 10000 / 2);
+    assert(pool.idle_count() == 4);
+#ifdef SQLITE_ENABLE_SNAPSHOT
+    assert(consistent); // all ranges opened the snapshot of the first connection
+#else
+    assert(!consistent); // ranges read their own snapshots
+#endif
+
+    // partial results are merged in rowid order
+    std::function<std::string(SQLITE3_CURSOR &)> first_id = [](SQLITE3_CURSOR &cursor) {
+        return cursor.next() ? cursor.get<std::string>(0) + "," : std::string();
+    };
+    std::function<std::string(std::string, std::string)> concat = [](std::string a, std::string b) {
+        return a + b;
+    };
+    std::string firsts;
+    assert(!pool.parallel_scan("test", "SELECT id FROM test WHERE rowid BETWEEN ? AND ? ORDER BY rowid;",
+                               first_id, concat, firsts, 2));
+    assert(firsts == "0,5000,");
+
+    // failed ranges are reported
+    int64_t ignored = 0;
+    assert(pool.parallel_scan("test", "SELECT no_such_column FROM test WHERE rowid BETWEEN ? AND ?;", sum, add,
+                              ignored));
+    assert(pool.idle_count() == 4);
+
+    // connections held by the caller shrink the scan instead of blocking it
+    {
+        auto held_a = pool.acquire();
+        auto held_b = pool.acquire();
+        auto held_c = pool.acquire();
+        scanned = 0;
+        consistent = false;
+        assert(!pool.parallel_scan("test", "SELECT id FROM test WHERE rowid BETWEEN ? AND ?;", sum, add, scanned, 0,
+                                   &consistent));
+        assert(scanned == (int64_t) 9999 * 10000 / 2);
+        assert(pool.idle_count() == 1);
+        assert(consistent); // a single range
+    }
+
+    // a transaction that cannot be committed is rolled back before the connection is reused
+    {
+        auto db = pool.acquire();
+        int rc = db->execute("COMMIT; PRAGMA foreign_keys = ON; BEGIN;") ||
+                 db->execute("CREATE TABLE parent (id int PRIMARY KEY);") ||
+                 db->execute("CREATE TABLE child (parent int REFERENCES parent (id) DEFERRABLE INITIALLY DEFERRED);") ||
+                 db->commit() || db->execute("INSERT INTO child VALUES (1);");
+        assert(!rc);
+    }
+    {
+        auto db = pool.acquire(); // the same connection, the last one returned
+        int rc = db->execute("SELECT COUNT(*) FROM child;");
+        assert(!rc && db->get_row_result()->get(0, 0) == "0");
+        rc = db->execute("INSERT INTO parent VALUES (1); INSERT INTO child VALUES (1);") || db->commit();
+        assert(!rc && db->error_no == NO_ERROR);
+    }
+
+    // rowids spanning the full 64 bit range
+    {
+        auto db = pool.acquire();
+        assert(!db->execute("CREATE TABLE extremes (id int);"));
+        assert(!db->execute("INSERT INTO extremes (rowid, id) VALUES (-9223372036854775808, 1), (9223372036854775807, 2);"));
+    }
+    scanned = 0;
+    assert(!pool.parallel_scan("extremes", "SELECT id FROM extremes WHERE rowid BETWEEN ? AND ?;", sum, add, scanned));
+    assert(scanned == 3);
+    assert(pool.idle_count() == 4);
+
+    std::remove("pool_test.db");
+    std::remove("pool_test.db-wal");
+    std::remove("pool_test.db-shm");
+    return 0;
+}
@@ -22,6 +22,7 @@
 #include "SQLITE3_QUERY.hpp"
 
 #include <cassert>
+#include <cmath>
 
 int main () {
     SQLITE3_QUERY query;
@@ -51,4 +52,36 @@ int main () {
     query3.reset_binding();
     query3.add_binding("abc", "def", "ghi");
     assert(query.bind().bound_query == query3.bind().bound_query);
+
+    // check typed bindings
+    query3.set_query_template("? ? ? ? ?").reset_binding();
+    query3.add_binding(42, 0.5, nullptr, "x");
+    const char blob[] = {'\x01', '\xAB'};
+    query3.add_blob_binding(blob, sizeof(blob));
+    assert(query3.values.size() == 5);
+    assert(query3.values[0].type == SQLITE3_VALUE::INTEGER_VALUE && query3.values[0].integer == 42);
+    assert(query3.values[1].type == SQLITE3_VALUE::FLOAT_VALUE && query3.values[1].real == 0.5);
+    assert(query3.values[2].type == SQLITE3_VALUE::NULL_VALUE);
+    assert(query3.values[3].type == SQLITE3_VALUE::TEXT_VALUE && query3.values[3].bytes == "x");
+    assert(query3.values[4].type == SQLITE3_VALUE::BLOB_VALUE && query3.values[4].bytes.size() == 2);
+    assert(query3.bind().bound_query == "42 0.5 NULL 'x' X'01AB'");
+    query3.set_query_template("?").reset_binding();
+    query3.add_zeroblob_binding(4096);
+    assert(query3.values[0].type == SQLITE3_VALUE::ZEROBLOB_VALUE && query3.values[0].integer == 4096);
+    assert(query3.bind().bound_query == "zeroblob(4096)");
+
+    // check non finite reals
+    query3.set_query_template("? ? ?").reset_binding();
+    query3.add_binding(HUGE_VAL, -HUGE_VAL, std::nan(""));
+    assert(query3.bind().bound_query == "9e999 -9e999 NULL");
+
+    // check missing binding
+    query3.reset_binding();
+    bool thrown = false;
+    try {
+        query3.bind();
+    } catch (std::out_of_range &e) {
+        thrown = true;
+    }
+    assert(thrown);
 }
\ No newline at end of file
@@ -20,9 +20,59 @@
 //
 
 #include "SQLITE3.hpp"
+#include "SQLITE3_ARROW_READER.hpp"
 #include "SQLITE3_QUERY.hpp"
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
 #include <sqlite3.h>
+#include <thread>
+
+struct TEST_ROW {
+    int64_t id;
+    std::string data;
+};
+
+template<>
+struct SQLITE3_ROW_MAPPING<TEST_ROW> {
+    static std::tuple<int64_t TEST_ROW::*, std::string TEST_ROW::*> members() {
+        return std::make_tuple(&TEST_ROW::id, &TEST_ROW::data);
+    }
+};
+
+struct TEST_PRODUCT {
+    int64_t product = 1;
+
+    void step(int64_t value) {
+        product *= value;
+    }
+
+    int64_t final() {
+        return product;
+    }
+};
+
+struct TEST_MOVING_SUM {
+    int64_t sum = 0;
+
+    void step(int64_t value) {
+        sum += value;
+    }
+
+    void inverse(int64_t value) {
+        sum -= value;
+    }
+
+    int64_t value() {
+        return sum;
+    }
+
+    int64_t final() {
+        return sum;
+    }
+};
+
 int main () {
     SQLITE3 db("test.db"); // init database
     if (db.execute("CREATE TABLE test (id int PRIMARY KEY, data text);")) {
@@ -66,27 +116,778 @@ int main () {
     assert(result->at(1).at(0) == "200");
     assert(result->at(1).at(1) == "bar");
 
+    // results are snapshots, later queries do not modify them
+    auto snapshot = db.get_row_result();
+    assert(snapshot->get_rows().data() == result->data());
+    db.execute("SELECT 1;");
+    assert(snapshot->row_count() == 2 && snapshot->get(1, 1) == "bar");
+    assert(result->at(1).at(1) == "bar" && column_name->at(1) == "data");
+    assert(db.get_row_result()->get(0, 0) == "1");
+
+    // rows of later statements keep their own number of columns
+    assert(!db.execute("SELECT 1; SELECT 2, 3;"));
+    auto statements = db.copy_result();
+    assert(statements->size() == 2);
+    assert(statements->at(0) == SQLITE_ROW_VECTOR({"1"}));
+    assert(statements->at(1) == SQLITE_ROW_VECTOR({"2", "3"}));
+    assert(db.get_row_result()->column_count() == 1 && db.get_row_result()->column_count(1) == 2);
+    assert(db.get_row_result()->get(1, 1) == "3");
+
+    // the storage of a released result is reused by the next query, held results are not
+    assert(!db.execute("SELECT data FROM test;"));
+    const SQLITE3_RESULT *storage = db.get_row_result().get();
+    assert(!db.execute("SELECT data FROM test;"));
+    auto held = db.get_row_result();
+    assert(held.get() == storage);
+    assert(!db.execute("SELECT data FROM test;"));
+    assert(db.get_row_result() != held);
+    size_t length;
+    assert(std::string(held->get_text(1, 0, length)) == "bar" && length == 3);
+    db.set_result_arena_limit(0);
+    assert(db.get_result_arena_limit() == 0);
+    assert(!db.execute("SELECT data FROM test;") && db.get_row_result()->get(0, 0) == "foo");
+
+    // once copy_result() was used, results are published with their rows built
+    assert(!db.execute("SELECT id, data FROM test;"));
+    auto prebuilt = db.get_row_result();
+    size_t prebuilt_bytes = prebuilt->capacity_bytes();
+    assert(db.copy_result()->at(1).at(1) == "bar" && prebuilt->capacity_bytes() == prebuilt_bytes);
+
+    // the deprecated get_result() keeps its rows until called again
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    assert(!db.execute("SELECT data FROM test;"));
+    const std::vector<SQLITE_ROW_VECTOR> *legacy = db.get_result();
+    assert(!db.execute("SELECT 1;") && !db.execute("SELECT 2;"));
+    assert(legacy->size() == 2 && legacy->at(0).at(0) == "foo");
+#pragma GCC diagnostic pop
+
+    // repeated templates reuse the cached prepared statement
+    SQLITE3_QUERY lookup("SELECT data FROM test WHERE id = ?;");
+    lookup.add_binding("100");
+    uint64_t misses = db.get_stmt_cache_misses();
+    uint64_t hits = db.get_stmt_cache_hits();
+    assert(!db.execute(lookup));
+    assert(!db.execute(lookup));
+    assert(db.get_stmt_cache_misses() == misses + 1);
+    assert(db.get_stmt_cache_hits() == hits + 1);
+    assert(db.copy_result()->at(0).at(0) == "foo");
+
+    // bindings are passed as values, quotes need no escaping
+    lookup.set_query_template("SELECT ?;").reset_binding().add_binding("it's");
+    assert(!db.execute(lookup));
+    assert(db.copy_result()->at(0).at(0) == "it's");
+
+    // typed bindings keep their type
+    lookup.set_query_template("SELECT typeof(?), typeof(?), typeof(?), typeof(?), ? + 1;").reset_binding();
+    lookup.add_binding(7, 1.5, nullptr, "text", 41);
+    assert(!db.execute(lookup));
+    result = db.copy_result();
+    assert(result->at(0).at(0) == "integer");
+    assert(result->at(0).at(1) == "real");
+    assert(result->at(0).at(2) == "null");
+    assert(result->at(0).at(3) == "text");
+    assert(result->at(0).at(4) == "42");
+
+    // missing binding
+    lookup.reset_binding();
+    assert(db.execute(lookup));
+    assert(db.error_no == QUERY_BINDING_ERROR);
+    db.error_no = NO_ERROR;
+
+    // infinities are bound natively and through the bound query of several statements
+    lookup.set_query_template("SELECT ?, ?;").reset_binding().add_binding(HUGE_VAL, -HUGE_VAL);
+    assert(!db.execute(lookup));
+    assert(db.copy_result()->at(0) == SQLITE_ROW_VECTOR({"Inf", "-Inf"}));
+    lookup.set_query_template("SELECT ?, ?, ?; SELECT 1;").reset_binding();
+    lookup.add_binding(HUGE_VAL, -HUGE_VAL, std::nan(""));
+    assert(!db.execute(lookup));
+    assert(db.copy_result()->at(0) == SQLITE_ROW_VECTOR({"Inf", "-Inf", "NULL"}));
+
+    // ? inside literals and comments is not a parameter
+    lookup.set_query_template("SELECT '?', ? /* ? */;").reset_binding().add_binding(5);
+    assert(!db.execute(lookup));
+    assert(db.copy_result()->at(0) == SQLITE_ROW_VECTOR({"?", "5"}));
+
+    // named and numbered parameters cannot be bound by position
+    lookup.set_query_template("SELECT :a, ?2;").reset_binding().add_binding(1, 2);
+    assert(db.execute(lookup));
+    assert(db.error_no == QUERY_BINDING_ERROR);
+    db.error_no = NO_ERROR;
+    lookup.set_query_template("SELECT :a;").reset_binding().add_binding(1);
+    assert(db.execute(lookup));
+    assert(db.error_no == QUERY_BINDING_ERROR);
+    db.error_no = NO_ERROR;
+    assert(db.query(lookup).error_no == QUERY_BINDING_ERROR);
+
+    // columnar result
+    db.set_result_mode(COLUMNAR_RESULT);
+    assert(!db.execute("SELECT id, data, id * 0.5 AS half, NULL AS missing FROM test ORDER BY id;"));
+    auto columns = db.get_columnar_result();
+    assert(columns->row_count() == 2);
+    assert(columns->column_count() == 4);
+    assert(columns->column_name(0) == "id");
+    assert(columns->column_type(0) == SQLITE3_COLUMNAR_RESULT::INTEGER_COLUMN);
+    assert(columns->column_type(1) == SQLITE3_COLUMNAR_RESULT::TEXT_COLUMN);
+    assert(columns->column_type(2) == SQLITE3_COLUMNAR_RESULT::FLOAT_COLUMN);
+    assert(columns->get<int64_t>(1, 0) == 200);
+    assert(columns->get<std::string>(0, 1) == "foo");
+    assert(columns->get<double>(1, 2) == 100.0);
+    assert(columns->is_null(0, 3) && !columns->is_null(0, 0));
+
+    // mixed column types are widened
+    assert(!db.execute("SELECT 1 UNION ALL SELECT 2.5 UNION ALL SELECT NULL UNION ALL SELECT 'x';"));
+    auto mixed = db.get_columnar_result();
+    assert(mixed->column_type(0) == SQLITE3_COLUMNAR_RESULT::TEXT_COLUMN);
+    assert(mixed->get<std::string>(0, 0) == "1.0"); // widened to float first
+    assert(mixed->get<std::string>(1, 0) == "2.5");
+    assert(mixed->is_null(2, 0));
+    assert(mixed->get<std::string>(3, 0) == "x");
+
+    // earlier results are not modified by later queries
+    assert(columns->row_count() == 2);
+    db.set_result_mode(ROW_RESULT);
+
+    // each call may return its own result, the shared result is left alone
+    assert(!db.execute("SELECT 1;"));
+    std::shared_ptr<const SQLITE3_RESULT> own_rows;
+    std::shared_ptr<const SQLITE3_COLUMNAR_RESULT> own_columns;
+    SQLITE3_QUERY by_id("SELECT data FROM test WHERE id = ?;");
+    by_id.add_binding(200);
+    int own_rc = db.execute(by_id, own_rows) || db.execute("SELECT id FROM test ORDER BY id;", own_columns);
+    assert(!own_rc);
+    assert(own_rows->row_count() == 1 && own_rows->get(0, 0) == "bar");
+    assert(own_columns->row_count() == 2 && own_columns->get<int64_t>(1, 0) == 200);
+    assert(db.get_row_result()->get(0, 0) == "1");
+    assert(db.execute("SELECT * FROM no_such_table;", own_rows) && own_rows->row_count() == 0);
+    db.error_no = NO_ERROR;
+
+    // copies run queries from several threads at once, each with its own result,
+    // a copy going out of scope does not close the connection of the others
+    std::atomic<int> thread_failures(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&db, t, &thread_failures] {
+            SQLITE3 copy = db;
+            for (int i = 0; i < 20 * (t + 1); ++i) {
+                std::shared_ptr<const SQLITE3_RESULT> rows;
+                SQLITE3_QUERY select("SELECT ? + id FROM test ORDER BY id;");
+                select.add_binding(t);
+                if (copy.execute(select, rows) || rows->row_count() != 2 ||
+                    rows->get(0, 0) != std::to_string(100 + t)) {
+                    thread_failures += 1;
+                }
+            }
+        });
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    assert(thread_failures == 0);
+    {
+        SQLITE3 copy = db;
+    }
+    assert(!db.execute("SELECT COUNT(*) FROM test;") && db.get_row_result()->get(0, 0) == "2");
+
+    // stream rows with a cursor
+    SQLITE3_QUERY select_all("SELECT id, data FROM test WHERE id >= ? ORDER BY id;");
+    select_all.add_binding(0);
+    auto cursor = db.query(select_all);
+    int rows = 0;
+    while (cursor.next()) {
+        assert(cursor.column_count() == 2);
+        assert(cursor.column_name(1) == "data");
+        assert(cursor.get<int64_t>(0) == (rows == 0 ? 100 : 200));
+        assert(cursor.get<std::string>(1) == (rows == 0 ? "foo" : "bar"));
+        rows += 1;
+    }
+    assert(rows == 2);
+    assert(!cursor.is_open());
+    assert(cursor.error_no == NO_ERROR);
+
+    // read rows in Arrow batches
+    SQLITE3_ARROW_READER arrow(db.query("WITH n(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM n WHERE x < 5) "
+                                        "SELECT x, CASE WHEN x % 2 THEN 'odd' END AS parity, x * 0.5 FROM n;"), 2);
+    ArrowArray batch;
+    ArrowSchema schema;
+    int64_t batch_rows = 0;
+    int batches = 0;
+    while (arrow.next_batch(&batch, &schema)) {
+        assert(std::string(schema.format) == "+s" && schema.n_children == 3 && batch.n_children == 3);
+        assert(std::string(schema.children[0]->name) == "x" && std::string(schema.children[0]->format) == "l");
+        assert(std::string(schema.children[1]->format) == "U" && std::string(schema.children[2]->format) == "g");
+        assert(reinterpret_cast<const int64_t *>(batch.children[0]->buffers[1])[0] == batch_rows + 1);
+        assert(reinterpret_cast<const double *>(batch.children[2]->buffers[1])[0] == (double) (batch_rows + 1) / 2);
+        ArrowArray *parity = batch.children[1];
+        assert(parity->n_buffers == 3 && parity->null_count == (batch.length == 2 ? 1 : 0));
+        auto parity_offsets = reinterpret_cast<const int64_t *>(parity->buffers[1]);
+        assert(std::string(reinterpret_cast<const char *>(parity->buffers[2]), (size_t) parity_offsets[1]) == "odd");
+        batch_rows += batch.length;
+        batches += 1;
+        batch.release(&batch);
+        schema.release(&schema);
+        assert(!batch.release && !schema.release);
+    }
+    assert(batches == 3 && batch_rows == 5 && arrow.error_no == NO_ERROR);
+    SQLITE3_ARROW_READER failed(db.query("SELECT * FROM no_such_table;"));
+    assert(!failed.next_batch(&batch, &schema) && failed.error_no == EXECUTION_ERROR);
+
+    // a whole columnar result, children outlive their parent when moved out
+    db.set_result_mode(COLUMNAR_RESULT);
+    int exported = db.execute("SELECT id, data, NULL FROM test ORDER BY id;") ||
+                   SQLITE3_ARROW_READER::export_result(db.get_columnar_result(), &batch, &schema);
+    db.set_result_mode(ROW_RESULT);
+    assert(!exported);
+    assert(batch.length == 2 && std::string(schema.children[2]->format) == "n");
+    ArrowArray data_column = *batch.children[1];
+    batch.children[1]->release = nullptr;
+    batch.release(&batch);
+    schema.release(&schema);
+    assert(data_column.n_buffers == 3 && data_column.null_count == 0);
+    assert(std::string(reinterpret_cast<const char *>(data_column.buffers[2]), 6) == "foobar");
+    data_column.release(&data_column);
+
+    // stop early
+    cursor = db.query(select_all);
+    assert(cursor.next());
+    cursor.close();
+    assert(!cursor.next());
+
+    // cursor errors
+    auto bad_cursor = db.query("SELECT * FROM no_such_table;");
+    assert(!bad_cursor.next());
+    assert(bad_cursor.error_no == EXECUTION_ERROR);
+
+    // read rows into structs
+    std::vector<TEST_ROW> mapped;
+    assert(!db.query_as(select_all, mapped));
+    assert(mapped.size() == 2);
+    assert(mapped[0].id == 100 && mapped[0].data == "foo");
+    assert(mapped[1].id == 200 && mapped[1].data == "bar");
+
+    // column count and types are checked before the first row
+    mapped.clear();
+    assert(db.query_as("SELECT id FROM test;", mapped));
+    assert(db.query_as("SELECT data, data FROM test;", mapped));
+    assert(db.error_no == EXECUTION_ERROR);
+    assert(mapped.empty());
+    db.error_no = NO_ERROR;
+    assert(db.query_as("SELECT * FROM no_such_table;", mapped));
+    db.error_no = NO_ERROR;
+
+    // columns declared without a type can be read into numbers
+    assert(!db.execute("CREATE TABLE untyped (id, data); INSERT INTO untyped VALUES (7, 'seven');"));
+    assert(!db.query_as("SELECT id, data FROM untyped;", mapped));
+    assert(mapped.size() == 1 && mapped[0].id == 7 && mapped[0].data == "seven");
+    assert(!db.execute("DROP TABLE untyped;"));
+    mapped.clear();
+
+    // runaway queries are stopped by the deadline
+    const char *runaway = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) SELECT COUNT(*) FROM c;";
+    db.set_query_timeout(std::chrono::milliseconds(20));
+    assert(db.execute(runaway));
+    assert(db.error_no == TIMEOUT_ERROR);
+    assert(db.get_timeout_count() == 1);
+    db.error_no = NO_ERROR;
+    db.set_query_timeout(std::chrono::milliseconds(0));
+    assert(!db.execute("SELECT COUNT(*) FROM test;"));
+
+    // queries run within a call keep its deadline once they return
+    {
+        SQLITE3 side(":memory:");
+        db.commit(); // an interrupted write rolls back the whole transaction
+        assert(!db.execute("CREATE TEMP TABLE endless (id int);"));
+        db.set_query_timeout(std::chrono::milliseconds(50));
+        int endless_rows = 0;
+        int rc = db.bulk_insert("endless", {"id"}, [&side, &endless_rows](SQLITE3_QUERY &row) {
+            if (endless_rows == 2000000) {
+                return false;
+            }
+            side.execute("SELECT 1;");
+            row.add_binding(endless_rows++);
+            return true;
+        });
+        assert(rc && db.error_no == TIMEOUT_ERROR && endless_rows < 2000000);
+        db.error_no = NO_ERROR;
+        db.set_query_timeout(std::chrono::milliseconds(0));
+        assert(!db.execute("DROP TABLE IF EXISTS endless;")); // rolled back with the interrupted transaction
+    }
+
+    // or cancelled from another thread
+    SQLITE3 shared = db;
+    std::atomic<bool> returned(false);
+    std::thread canceller([&shared, &returned] {
+        while (!returned) { // until the query started
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            shared.cancel();
+        }
+    });
+    assert(db.execute(runaway));
+    returned = true;
+    canceller.join();
+    assert(db.error_no == CANCELLED_ERROR);
+    assert(db.get_cancel_count() == 1);
+    db.error_no = NO_ERROR;
+    assert(!db.execute("SELECT COUNT(*) FROM test;"));
+
+    // repeated reads are answered from the result cache
+    assert(!db.execute("CREATE TABLE other (x int);"));
+    db.set_result_cache_budget(1 << 20);
+    auto result_cache = db.get_result_cache();
+    SQLITE3_QUERY cached("SELECT data FROM test WHERE id = ?;");
+    cached.add_binding(100);
+    assert(!db.execute(cached));
+    assert(!db.execute(cached));
+    assert(result_cache->get_misses() == 1 && result_cache->get_hits() == 1);
+    assert(db.copy_result()->at(0).at(0) == "foo");
+    assert(!db.execute("SELECT random();") && !db.execute("SELECT random();"));
+    assert(result_cache->get_hits() == 1);
+
+    // results are dropped when a table they were read from changes
+    assert(!db.execute("INSERT INTO other VALUES (1);"));
+    assert(!db.execute(cached));
+    assert(result_cache->get_hits() == 2);
+    assert(!db.execute("UPDATE test SET data = 'baz' WHERE id = 100;"));
+    assert(!db.execute(cached));
+    assert(db.copy_result()->at(0).at(0) == "baz");
+    assert(result_cache->get_hits() == 2);
+
+    // and when the change is rolled back
+    assert(!db.execute("SAVEPOINT change; UPDATE test SET data = 'qux' WHERE id = 100;"));
+    assert(!db.execute(cached));
+    assert(db.copy_result()->at(0).at(0) == "qux");
+    assert(!db.execute("ROLLBACK TO change; RELEASE change;"));
+    assert(!db.execute(cached));
+    assert(db.copy_result()->at(0).at(0) == "baz");
+
+    // or another connection committed
+    assert(!db.execute(cached));
+    uint64_t cached_hits = result_cache->get_hits();
+    db.commit();
+    {
+        SQLITE3 writer("test.db");
+        assert(!writer.execute("UPDATE test SET data = 'foo' WHERE id = 100;"));
+        assert(!writer.commit());
+    }
+    assert(!db.execute(cached));
+    assert(db.copy_result()->at(0).at(0) == "foo");
+    assert(result_cache->get_hits() == cached_hits);
+    assert(result_cache->get_size() > 0 && result_cache->get_invalidations() > 0);
+    assert(!db.execute("DROP TABLE other;"));
+    assert(result_cache->get_count() == 0);
+
+    // table names are case insensitive, rows of WITHOUT ROWID tables are not seen by the update hook
+    assert(!db.execute("CREATE TABLE Keyed (id int PRIMARY KEY, data text) WITHOUT ROWID;"));
+    assert(!db.execute("SELECT COUNT(*) FROM keyed;") && !db.execute("SELECT COUNT(*) FROM keyed;"));
+    cached_hits = result_cache->get_hits();
+    int keyed_rows = 0;
+    assert(!db.bulk_insert("KEYED", {"id", "data"}, [&keyed_rows](SQLITE3_QUERY &row) {
+        if (keyed_rows == 3) {
+            return false;
+        }
+        row.add_binding(keyed_rows++, "data");
+        return true;
+    }));
+    assert(!db.execute("SELECT COUNT(*) FROM keyed;"));
+    assert(db.get_row_result()->get(0, 0) == "3");
+    assert(result_cache->get_hits() == cached_hits);
+    assert(!db.execute("DROP TABLE Keyed;"));
+
+    // the hooks of a connection are removed before it is closed, a cursor may keep it open
+    {
+        std::unique_ptr<SQLITE3> owner(new SQLITE3(":memory:"));
+        owner->set_result_cache_budget(1 << 20);
+        assert(!owner->execute("CREATE TABLE t (x int); INSERT INTO t VALUES (1);"));
+        auto cursor = owner->query("SELECT x FROM t;");
+        owner.reset();
+        assert(cursor.next() && cursor.get<int64_t>(0) == 1);
+    } // closing rolls back the open transaction
+    db.set_result_cache_budget(0);
+
+    // cache capacity
+    db.set_stmt_cache_capacity(0);
+    assert(db.get_stmt_cache_capacity() == 0);
+    db.set_stmt_cache_capacity(16);
+
     // commit to save changes
     db.commit();
     std::cout << "Changes committed" << std::endl;
 
+    // per statement profiling
+    assert(!db.enable_profiling());
+    int slow_queries = 0;
+    db.get_profiler()->set_slow_query_callback(std::chrono::nanoseconds(0),
+                                               [&slow_queries](const std::string &, const std::string &expanded,
+                                                               uint64_t) {
+                                                   assert(expanded.find("100") != std::string::npos);
+                                                   slow_queries += 1;
+                                               });
+    SQLITE3_QUERY profiled("SELECT data FROM test WHERE id = ?;");
+    profiled.add_binding(100);
+    for (int i = 0; i < 10; ++i) {
+        assert(!db.execute(profiled));
+    }
+    db.get_profiler()->set_slow_query_callback(std::chrono::nanoseconds(0), nullptr);
+    assert(slow_queries == 10);
+    auto profile = db.get_profiler()->get_stats();
+    assert(profile.at(profiled.query_template).count == 10);
+    assert(profile.at(profiled.query_template).percentile(0.99) <= profile.at(profiled.query_template).max_ns);
+    assert(db.get_profiler()->to_json().find("\"sql\":\"SELECT data FROM test WHERE id = ?;\",\"count\":10") !=
+           std::string::npos);
+    assert(!db.enable_profiling(false));
+    db.get_profiler()->reset();
+
+    // a cursor keeps the connection and its profiler alive after the last copy is gone
+    {
+        std::unique_ptr<SQLITE3> owner(new SQLITE3(":memory:"));
+        owner->enable_profiling();
+        auto cursor = owner->query("SELECT 1 UNION ALL SELECT 2;");
+        owner.reset();
+        int cursor_rows = 0;
+        while (cursor.next()) {
+            cursor_rows += 1;
+        }
+        assert(cursor_rows == 2);
+    }
+
+    // bulk insert with index rebuild
+    assert(!db.execute("CREATE TABLE bulk (id int PRIMARY KEY, value real, label text);"));
+    assert(!db.execute("CREATE INDEX bulk_label ON bulk (label);"));
+    int next_id = 0;
+    assert(!db.bulk_insert("bulk", {"id", "value", "label"}, [&next_id](SQLITE3_QUERY &row) {
+        if (next_id == 25000) {
+            return false;
+        }
+        row.add_binding(next_id, next_id * 0.5, "label" + std::to_string(next_id % 10));
+        next_id += 1;
+        return true;
+    }, true));
+    assert(!db.execute("SELECT COUNT(*), SUM(value) FROM bulk;"));
+    assert(db.copy_result()->at(0).at(0) == "25000");
+    assert(!db.execute("SELECT name FROM sqlite_master WHERE type = 'index' AND name = 'bulk_label';"));
+    assert(db.get_result_row_count() == 1);
+
+    // failed bulk insert leaves no rows behind
+    next_id = 24990;
+    assert(db.bulk_insert("bulk", {"id", "value", "label"}, [&next_id](SQLITE3_QUERY &row) {
+        if (next_id == 30000) {
+            return false;
+        }
+        row.add_binding(next_id, 0.0, "duplicate");
+        next_id += 1;
+        return true;
+    }));
+    assert(db.error_no == EXECUTION_ERROR);
+    db.error_no = NO_ERROR;
+    assert(!db.execute("SELECT COUNT(*) FROM bulk;"));
+    assert(db.copy_result()->at(0).at(0) == "25000");
+    assert(!db.execute("DROP TABLE bulk;"));
+    db.commit();
+
+    // blobs are preallocated with zeroblob and streamed in chunks
+    assert(!db.execute("CREATE TABLE payload (id INTEGER PRIMARY KEY, data blob);"));
+    SQLITE3_QUERY preallocate("INSERT INTO payload VALUES (?, ?);");
+    preallocate.add_binding(1);
+    preallocate.add_zeroblob_binding(100000);
+    assert(!db.execute(preallocate));
+    auto writer = db.open_blob("payload", "data", 1, true);
+    assert(writer.is_open() && writer.size() == 100000);
+    std::string chunk(1000, '\0');
+    for (size_t offset = 0; offset < 100000; offset += chunk.size()) {
+        chunk[1] = (char) (offset / chunk.size());
+        assert(!writer.write(chunk.data(), chunk.size(), offset));
+    }
+    assert(writer.write("x", 1, 100000)); // cannot grow
+    assert(writer.error_no == EXECUTION_ERROR);
+    writer.close();
+
+    auto reader = db.open_blob("payload", "data", 1);
+    char bytes[2];
+    assert(!reader.read(bytes, 2, 42001) && bytes[0] == (char) 42);
+    size_t streamed = 0;
+    assert(!reader.read_chunks(1000, [&streamed](const char *data, size_t length, size_t offset) {
+        assert(offset == 1000 + streamed && length == 1000 && data[1] == (char) (offset / 1000));
+        streamed += length;
+        return true;
+    }, 1000));
+    assert(streamed == 99000);
+    streamed = 0;
+    assert(!reader.read_chunks(4096, [&streamed](const char *, size_t length, size_t) {
+        streamed += length;
+        return false; // stop after the first chunk
+    }));
+    assert(streamed == 4096);
+
+    // empty chunks and ranges sqlite cannot address are rejected
+    assert(reader.read_chunks(0, [](const char *, size_t, size_t) { return true; }));
+    assert(reader.error_no == EXECUTION_ERROR);
+    reader.error_no = NO_ERROR;
+    assert(reader.read(bytes, 2, ((size_t) 1 << 32) + 42001)); // would wrap around to 42001 as an int
+    assert(reader.error_no == EXECUTION_ERROR);
+    reader.error_no = NO_ERROR;
+    assert(db.open_blob("payload", "missing", 1).error_no == EXECUTION_ERROR);
+    assert(reader.write("x", 1, 0)); // opened read only
+
+    // blobs keep their NUL bytes in the row result
+    assert(!db.execute("SELECT length(data), substr(data, 1, 3) FROM payload;"));
+    assert(db.get_row_result()->get(0, 0) == "100000");
+    assert(db.get_row_result()->get(0, 1) == std::string(3, '\0'));
+    reader.close();
+    assert(!db.execute("DROP TABLE payload;"));
+    db.commit();
+
+    // online backup into a file, a few pages per step
+    assert(!db.execute("CREATE TABLE archive (id int PRIMARY KEY, data text);"));
+    next_id = 0;
+    assert(!db.bulk_insert("archive", {"id", "data"}, [&next_id](SQLITE3_QUERY &row) {
+        if (next_id == 2000) {
+            return false;
+        }
+        row.add_binding(next_id, std::string(100, 'a'));
+        next_id += 1;
+        return true;
+    }));
+    std::remove("backup_test.db");
+    assert(db.backup_to("backup_test.db") && db.error_no == EXECUTION_ERROR); // uncommitted
+    db.error_no = NO_ERROR;
+    db.commit();
+    assert(!db.backup_to("backup_test.db", 4, std::chrono::milliseconds(0)));
+    {
+        SQLITE3 copy("backup_test.db");
+        assert(!copy.execute("SELECT COUNT(*) FROM archive;"));
+        assert(copy.get_row_result()->get(0, 0) == "2000");
+
+        // into another connection, in memory
+        SQLITE3 memory(":memory:");
+        assert(!memory.execute("CREATE TABLE scratch (id int);"));
+        assert(!copy.backup_to(memory));
+        assert(!memory.execute("SELECT COUNT(*) FROM archive;"));
+        assert(memory.get_row_result()->get(0, 0) == "2000");
+        assert(memory.execute("SELECT * FROM scratch;"));
+        assert(db.backup_to(db) && db.error_no == EXECUTION_ERROR);
+        db.error_no = NO_ERROR;
+    }
+
+    // a backup gives up once the database stayed locked for the busy timeout
+    {
+        sqlite3 *locker = nullptr;
+        sqlite3_open("test.db", &locker);
+        sqlite3_exec(locker, "BEGIN EXCLUSIVE;", nullptr, nullptr, nullptr);
+        int rc = db.set_busy_backoff(std::chrono::milliseconds(1), std::chrono::milliseconds(5),
+                                     std::chrono::milliseconds(30));
+        assert(!rc);
+        rc = db.backup_to("backup_test.db", 4, std::chrono::milliseconds(1));
+        assert(rc && db.error_no == EXECUTION_ERROR);
+        db.error_no = NO_ERROR;
+        sqlite3_exec(locker, "ROLLBACK;", nullptr, nullptr, nullptr);
+        sqlite3_close(locker);
+        rc = db.set_busy_timeout(std::chrono::milliseconds(0));
+        assert(!rc);
+    }
+
+    // serialized images load into memory
+    std::string image;
+    assert(!db.serialize(image));
+    assert(image.size() % 4096 == 0 && image.compare(0, 15, "SQLite format 3") == 0);
+    {
+        SQLITE3 snapshot_db(":memory:");
+        assert(!snapshot_db.deserialize(image, true));
+        assert(!snapshot_db.execute("SELECT COUNT(*) FROM archive;"));
+        assert(snapshot_db.get_row_result()->get(0, 0) == "2000");
+        assert(snapshot_db.execute("DELETE FROM archive;")); // read only
+        assert(!snapshot_db.deserialize("not a database"));
+        assert(snapshot_db.execute("SELECT COUNT(*) FROM archive;"));
+    }
+    assert(!db.execute("DROP TABLE archive;"));
+    db.commit();
+    std::remove("backup_test.db");
+
     // add user defined function to database
     db.add_function("PrintHello", //name of function
                     1, // number of argument the UDF take
                     [](sqlite3_context* c, int argc, sqlite3_value** value){ // function implementation
                         int id = sqlite3_value_int(value[0]);
                         std::string result = std::string("Hello" + std::to_string(id));
-                        sqlite3_result_text(c, result.c_str(), result.length(), nullptr);
+                        sqlite3_result_text(c, result.c_str(), result.length(), SQLITE_TRANSIENT);
                     });
     db.execute("SELECT PrintHello(id) FROM TEST;");
     result = db.copy_result();
     assert(result->at(0).at(0) == "Hello100");
     assert(result->at(1).at(0) == "Hello200");
 
+    // typed functions may capture state
+    int calls = 0;
+    assert(!db.add_function("greet", [&calls](const std::string &name, int64_t times) {
+        calls += 1;
+        std::string greeting;
+        for (int64_t i = 0; i < times; ++i) {
+            greeting += "hi " + name + ";";
+        }
+        return greeting;
+    }, SQLITE_DETERMINISTIC));
+    assert(!db.execute("SELECT greet(data, 2) FROM test ORDER BY id;"));
+    assert(db.get_row_result()->get(1, 0) == "hi bar;hi bar;" && calls == 2);
+    assert(!db.add_function("half", [](double value) { return value / 2; }));
+    assert(!db.add_function("ignored", [](sqlite3_value *value) {
+        assert(sqlite3_value_type(value) == SQLITE_NULL);
+    }));
+    assert(!db.execute("SELECT half(5), ignored(NULL);"));
+    assert(db.get_row_result()->get(0, 0) == "2.5" && db.get_row_result()->get(0, 1) == "NULL");
+    assert(!db.add_function("fail", [](int64_t) -> int64_t { throw std::runtime_error("no good"); }));
+    assert(db.execute("SELECT fail(1);") && db.error_no == EXECUTION_ERROR);
+    db.error_no = NO_ERROR;
+    assert(db.add_function(std::string(300, 'f'), [](int64_t) { return 0; }) && db.error_no == EXECUTION_ERROR);
+    db.error_no = NO_ERROR;
+
+    // queries calling functions added without SQLITE_DETERMINISTIC are not cached
+    db.set_result_cache_budget(1 << 20);
+    int64_t counter = 0;
+    assert(!db.add_function("next_value", [&counter]() { return ++counter; }));
+    assert(!db.execute("SELECT next_value();") && !db.execute("SELECT next_value();"));
+    assert(db.get_row_result()->get(0, 0) == "2");
+    uint64_t cache_hits = db.get_result_cache()->get_hits();
+    assert(!db.execute("SELECT greet('x', 1);") && !db.execute("SELECT greet('x', 1);"));
+    assert(db.get_result_cache()->get_hits() == cache_hits + 1);
+    db.set_result_cache_budget(0);
+
+    // aggregate and window functions
+    assert(!db.add_aggregate<TEST_PRODUCT>("product", SQLITE_DETERMINISTIC));
+    assert(!db.execute("SELECT product(id) FROM test;"));
+    assert(db.get_row_result()->get(0, 0) == "20000");
+    assert(!db.execute("SELECT product(id) FROM test WHERE id < 0;")); // no rows
+    assert(db.get_row_result()->get(0, 0) == "1");
+    assert(!db.add_window_function<TEST_MOVING_SUM>("moving_sum"));
+    assert(!db.execute("WITH n(x) AS (VALUES (1), (2), (3), (4)) "
+                       "SELECT moving_sum(x) OVER (ORDER BY x ROWS BETWEEN 1 PRECEDING AND CURRENT ROW) FROM n;"));
+    auto sums = db.get_row_result();
+    assert(sums->row_count() == 4 && sums->get(0, 0) == "1" && sums->get(3, 0) == "7");
+    assert(!db.execute("SELECT moving_sum(id) FROM test;"));
+    assert(db.get_row_result()->get(0, 0) == "300");
+
+    // containers exposed as virtual tables
+    std::vector<TEST_ROW> live_rows;
+    for (int64_t i = 0; i < 1000; i++) {
+        live_rows.push_back(TEST_ROW{i * 2, "row " + std::to_string(i)});
+    }
+    assert(!db.add_vector_table("live", live_rows, {"id", "data"}, "id"));
+    assert(!db.execute("SELECT count(*), sum(id) FROM live;"));
+    assert(db.get_row_result()->get(0, 0) == "1000" && db.get_row_result()->get(0, 1) == "999000");
+    assert(!db.execute("SELECT data FROM live WHERE id = 200;"));
+    assert(db.get_row_result()->row_count() == 1 && db.get_row_result()->get(0, 0) == "row 100");
+    assert(!db.execute("SELECT count(*) FROM live WHERE id > 10 AND id <= 20.5;"));
+    assert(db.get_row_result()->get(0, 0) == "5");
+    assert(!db.execute("SELECT id FROM live WHERE rowid BETWEEN 3 AND 5;"));
+    assert(db.get_row_result()->row_count() == 3 && db.get_row_result()->get(2, 0) == "10");
+    assert(!db.execute("SELECT id FROM live WHERE data = 'row 7';"));
+    assert(db.get_row_result()->get(0, 0) == "14");
+    assert(!db.execute("SELECT count(*) FROM live WHERE data < 'row 2';"));
+    assert(db.get_row_result()->get(0, 0) == "112");
+    // values of another type and other collations are left to SQLite
+    assert(!db.execute("SELECT count(*) FROM live WHERE id = '10' OR data = 'ROW 9' COLLATE NOCASE;"));
+    assert(db.get_row_result()->get(0, 0) == "2");
+    assert(!db.execute("SELECT id FROM live ORDER BY id LIMIT 1 OFFSET 5;"));
+    assert(db.get_row_result()->get(0, 0) == "10");
+    assert(!db.execute("SELECT l.data FROM test t JOIN live l ON l.id = t.id ORDER BY t.id;"));
+    assert(db.get_row_result()->row_count() == 2 && db.get_row_result()->get(1, 0) == "row 100");
+
+    // the next query sees changes to the vector, it is never cached
+    db.set_result_cache_budget(1 << 20);
+    assert(!db.execute("SELECT count(*) FROM live;"));
+    live_rows.push_back(TEST_ROW{2000, "appended"});
+    assert(!db.execute("SELECT count(*) FROM live;"));
+    assert(db.get_row_result()->get(0, 0) == "1001");
+    db.set_result_cache_budget(0);
+
+    TEST_ROW fixed_rows[] = {{3, "c"}, {1, "a"}, {2, "b"}};
+    assert(!db.add_range_table("fixed", fixed_rows, fixed_rows + 3, {"id", "data"}));
+    assert(!db.execute("SELECT group_concat(data, '') FROM fixed WHERE id >= 2;"));
+    assert(db.get_row_result()->get(0, 0) == "cb");
+    assert(db.add_vector_table("bad", live_rows, {"id"}) && db.error_no == EXECUTION_ERROR);
+    db.error_no = NO_ERROR;
+    assert(db.add_vector_table("bad", live_rows, {"id", "data"}, "missing") && db.error_no == EXECUTION_ERROR);
+    db.error_no = NO_ERROR;
+
     // drop table
     db.execute("DROP TABLE test;");
     std::cout << "Table test dropped" << std::endl;
     db.commit();
 
+    // writers back off while another connection holds the lock
+    std::remove("busy_test.db");
+    {
+        SQLITE3 first("busy_test.db");
+        SQLITE3 second("busy_test.db");
+        int rc = first.execute("CREATE TABLE contended (x int);") || first.commit() ||
+                 second.execute("INSERT INTO contended VALUES (1);");
+        assert(!rc);
+        rc = first.set_busy_backoff(std::chrono::milliseconds(1), std::chrono::milliseconds(5),
+                                    std::chrono::milliseconds(30));
+        assert(!rc);
+        rc = first.execute("INSERT INTO contended VALUES (2);");
+        assert(rc && first.error_no == EXECUTION_ERROR);
+        first.error_no = NO_ERROR;
+        SQLITE3_BUSY_STATS busy = first.get_busy_stats();
+        assert(busy.contentions == 1 && busy.timeouts == 1 && busy.waits > 0);
+        assert(busy.wait_time >= std::chrono::milliseconds(30));
+
+        // COMMIT is run again while a reader holds the database
+        rc = first.commit() || first.execute("SELECT COUNT(*) FROM contended;");
+        assert(!rc);
+        second.set_commit_retries(2);
+        rc = second.commit();
+        assert(rc);
+        second.error_no = NO_ERROR;
+        assert(second.get_busy_stats().commit_retries == 2);
+
+        // COMMIT waits in the busy handler, its retries share the timeout
+        rc = second.set_busy_backoff(std::chrono::milliseconds(1), std::chrono::milliseconds(5),
+                                     std::chrono::milliseconds(30));
+        assert(!rc);
+        second.set_commit_retries(100);
+        auto started = std::chrono::steady_clock::now();
+        rc = second.commit();
+        assert(rc);
+        second.error_no = NO_ERROR;
+        assert(std::chrono::steady_clock::now() - started < std::chrono::seconds(1));
+        assert(second.get_busy_stats().commit_retries == 2);
+        rc = first.commit() || second.commit() || first.execute("SELECT COUNT(*) FROM contended;");
+        assert(!rc && first.copy_result()->at(0).at(0) == "1");
+    }
+    std::remove("busy_test.db");
+
+    // options are applied when the database is opened
+    std::remove("options_test.db");
+    SQLITE3_OPTIONS options = SQLITE3_OPTIONS::preset("read-mostly");
+    options.page_size = 8192;
+    SQLITE3 tuned("options_test.db", options);
+    assert(!tuned.execute("PRAGMA journal_mode;"));
+    assert(tuned.copy_result()->at(0).at(0) == "wal");
+    assert(!tuned.execute("PRAGMA synchronous;"));
+    assert(tuned.copy_result()->at(0).at(0) == "1");
+    assert(!tuned.execute("PRAGMA cache_size;"));
+    assert(tuned.copy_result()->at(0).at(0) == "-65536");
+    assert(!tuned.execute("PRAGMA page_size;"));
+    assert(tuned.copy_result()->at(0).at(0) == "8192");
+    std::string options_db = "options_test.db";
+    assert(!tuned.open(options_db, SQLITE3_OPTIONS::preset("durable")));
+    assert(!tuned.execute("PRAGMA synchronous;"));
+    assert(tuned.copy_result()->at(0).at(0) == "2");
+
+    // invalid options fail to open
+    SQLITE3_OPTIONS read_only;
+    read_only.open_flags = SQLITE_OPEN_READONLY;
+    std::string missing_db = "no_such_file.db";
+    assert(tuned.open(missing_db, read_only));
+    assert(tuned.error_no == OPEN_ERROR);
+    tuned.error_no = NO_ERROR;
+    bool thrown = false;
+    try {
+        SQLITE3_OPTIONS::preset("fast");
+    } catch (std::invalid_argument &e) {
+        thrown = true;
+    }
+    assert(thrown);
+    std::remove("options_test.db");
+
     return 0;
 }
\ No newline at end of file
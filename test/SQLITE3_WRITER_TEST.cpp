@@ -0,0 +1,102 @@
+//
+// SQLitePlus
+//    Copyright (C) <2020>  <Yuqian Cao> (kcyq98@gmail.com)
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#include "SQLITE3_WRITER.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <thread>
+
+int main() {
+    std::remove("writer_test.db");
+    {
+        SQLITE3_WRITER writer("writer_test.db", 100, std::chrono::milliseconds(5));
+        assert(writer.write("CREATE TABLE test (id int PRIMARY KEY, data text);").get() == 0);
+
+        // write from many threads
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; ++t) {
+            producers.emplace_back([&writer, t] {
+                std::vector<std::future<int>> results;
+                SQLITE3_QUERY insert("INSERT INTO test VALUES (?, ?);");
+                for (int i = 0; i < 250; ++i) {
+                    insert.reset_binding().add_binding(t * 1000 + i, "data");
+                    results.push_back(writer.write(insert));
+                }
+                for (auto &result : results) {
+                    assert(result.get() == 0);
+                }
+            });
+        }
+        for (auto &producer : producers) {
+            producer.join();
+        }
+
+        // failed statements are reported to their caller only
+        SQLITE3_QUERY duplicate("INSERT INTO test VALUES (?, ?);");
+        duplicate.add_binding(0, "data");
+        auto failed = writer.write(duplicate);
+        auto ok = writer.write("INSERT INTO test VALUES (5000, 'data');");
+        assert(failed.get() == 1);
+        assert(ok.get() == 0);
+
+        // a statement rolling back the transaction fails the earlier statements of its batch
+        auto lost = writer.write("INSERT INTO test VALUES (6000, 'data');");
+        auto rollback = writer.write("INSERT OR ROLLBACK INTO test VALUES (0, 'data');");
+        auto after = writer.write("INSERT INTO test VALUES (6001, 'data');");
+        int rc = lost.get();
+        assert(rc == 1);
+        rc = rollback.get();
+        assert(rc == 1);
+        rc = after.get();
+        assert(rc == 0);
+
+        // a failed commit is rolled back, not made durable by the next one
+        SQLITE3 reader("writer_test.db");
+        reader.execute("SELECT COUNT(*) FROM test;"); // holds a shared lock until its commit
+        rc = writer.write("INSERT INTO test VALUES (7000, 'data');").get();
+        assert(rc == 1);
+        reader.commit();
+        rc = writer.write("INSERT INTO test VALUES (7001, 'data');").get();
+        assert(rc == 0);
+
+        // statements were grouped into batches, the batch rolled back is not counted
+        assert(writer.get_write_count() == 1007);
+        assert(writer.get_batch_count() < 1007);
+
+        // batches are bounded by rows, a statement changing 250 rows fills its batch alone
+        uint64_t batches = writer.get_batch_count();
+        auto copied = writer.write("INSERT INTO test SELECT id + 10000, data FROM test WHERE id < 250;");
+        auto next = writer.write("INSERT INTO test VALUES (8000, 'data');");
+        rc = copied.get() || next.get();
+        assert(!rc);
+        assert(writer.get_batch_count() == batches + 2);
+    }
+
+    // everything committed is durable, nothing else
+    SQLITE3 db("writer_test.db");
+    assert(!db.execute("SELECT COUNT(*) FROM test;"));
+    assert(db.copy_result()->at(0).at(0) == "1254");
+    assert(!db.execute("SELECT COUNT(*) FROM test WHERE id IN (6000, 7000);"));
+    assert(db.copy_result()->at(0).at(0) == "0");
+
+    std::remove("writer_test.db");
+    return 0;
+}